@@ -0,0 +1,197 @@
+/*Copyright 2017 Jonathan Campbell
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.*/
+//checked_bit_allocator - lock-free allocator of integer ids (slots, indices) built from atomic BIT_FIELD words
+#pragma once
+#include "Bitvector.h"
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
+//Hands out the ids [0, capacity) from any number of threads without a lock. Each id is a bit of a leaf word,
+//set while the id is taken, and is claimed with one fetch_or on the lowest free bit. A summary level keeps
+//one bit per leaf, set while the leaf is full, so a search skips a word of full leaves at a time.
+//The summary is only a hint - a leaf's own word decides whether a claim succeeds.
+//field_type is a BIT_FIELD, its word type is the width of a leaf. Declare allocators through BIT_ALLOCATOR.
+template <typename field_type>
+class checked_bit_allocator
+{
+public:
+    typedef checked_atomic_bit_field<field_type> leaf_t;
+    typedef typename leaf_t::traits traits;
+    typedef typename traits::word_t word_t;
+    typedef typename traits::field_t field_t;
+    static_assert(std::is_unsigned<word_t>::value, "the BIT_FIELD word type must be unsigned");
+    static constexpr std::size_t word_bits = 8 * sizeof(word_t);
+    //returned by acquire when every id is taken
+    static constexpr std::size_t npos = static_cast<std::size_t>(-1);
+
+private:
+    //leaves that share a cache line, threads start their searches this many leaves apart
+    static constexpr std::size_t line_leaves = 64 / sizeof(word_t);
+    static constexpr word_t ones = static_cast<word_t>(~word_t(0));
+
+    std::size_t id_count;
+    std::vector<leaf_t, bitfield_aligned_allocator<leaf_t>> leaves;    //bit set - id taken
+    std::vector<leaf_t, bitfield_aligned_allocator<leaf_t>> summary;   //bit set - leaf full
+    std::atomic<std::size_t> next_start;                                //first id of the line given to the next thread
+
+    static field_t single(const std::size_t b) noexcept { return traits::to_field(static_cast<word_t>(word_t(1) << b)); }
+    static field_t all_but(const std::size_t b) noexcept { return traits::to_field(static_cast<word_t>(~(word_t(1) << b))); }
+
+    //where the calling thread's next search starts in this allocator. Threads start on different cache lines,
+    //and then continue after the id they were last given. A thread keeps the hint of the last allocator of
+    //the type it acquired from, switching to another allocator starts over from the next spread hint.
+    struct hint_t
+    {
+        const checked_bit_allocator* owner;
+        std::size_t next;
+    };
+    std::size_t& thread_hint() const noexcept
+    {
+        static thread_local hint_t hint = { nullptr, npos };
+        if (hint.owner != this)
+        {
+            hint.owner = this;
+            hint.next = npos;
+        }
+        return hint.next;
+    }
+    //the threads starting on this allocator take its cache lines of leaves in turn, so up to one thread per
+    //line none share a starting line
+    std::size_t spread_hint() noexcept
+    {
+        constexpr std::size_t line_ids = line_leaves * word_bits;
+        const std::size_t lines = (leaves.size() + line_leaves - 1) / line_leaves;
+        return next_start.fetch_add(line_ids, std::memory_order_relaxed) % (lines * line_ids);
+    }
+
+    void mark_full(const std::size_t leaf) noexcept
+    {
+        leaf_t& s = summary[leaf / word_bits];
+        s.fetch_or(single(leaf % word_bits));
+        //a release that came in before the summary bit was set found nothing to clear
+        if (traits::to_word(leaves[leaf].load()) != ones) s.fetch_and(all_but(leaf % word_bits));
+    }
+    void mark_open(const std::size_t leaf) noexcept { summary[leaf / word_bits].fetch_and(all_but(leaf % word_bits)); }
+
+    //claims the first free bit of leaf at or after bit start, wrapping round the leaf. npos if it is full.
+    std::size_t claim(const std::size_t leaf, const std::size_t start) noexcept
+    {
+        word_t w = traits::to_word(leaves[leaf].load(std::memory_order_relaxed));
+        while (w != ones)
+        {
+            const word_t free = static_cast<word_t>(~w), ahead = static_cast<word_t>(free & (ones << start));
+            const unsigned int b = bitfield_detail::countr_zero(ahead != 0 ? ahead : free);
+            const word_t m = static_cast<word_t>(word_t(1) << b);
+            w = traits::to_word(leaves[leaf].fetch_or(single(b)));
+            if ((w & m) == 0)
+            {
+                if (static_cast<word_t>(w | m) == ones) mark_full(leaf);
+                return leaf * word_bits + b;
+            }
+        }
+        return npos;
+    }
+
+public:
+    //--Constructors--
+    explicit checked_bit_allocator(const std::size_t capacity) : id_count(capacity), leaves((capacity + word_bits - 1) / word_bits),
+        summary((leaves.size() + word_bits - 1) / word_bits), next_start(0)
+    {
+        //bits past the last id are taken, summary bits past the last leaf are full
+        if (capacity % word_bits != 0) leaves.back().store(traits::to_field(static_cast<word_t>(ones << (capacity % word_bits))));
+        if (leaves.size() % word_bits != 0) summary.back().store(traits::to_field(static_cast<word_t>(ones << (leaves.size() % word_bits))));
+    }
+    checked_bit_allocator(const checked_bit_allocator&) = delete;
+    checked_bit_allocator& operator=(const checked_bit_allocator&) = delete;
+
+    //--Size--
+    std::size_t capacity() const noexcept { return id_count; }
+    //number of ids taken, only a snapshot while other threads acquire and release
+    std::size_t count() const noexcept
+    {
+        std::size_t n = 0;
+        for (const leaf_t& l : leaves) n += bitfield_detail::popcount(traits::to_word(l.load(std::memory_order_relaxed)));
+        return n - (leaves.size() * word_bits - id_count);
+    }
+    bool is_acquired(const std::size_t id) const noexcept { assert(id < id_count); return leaves[id / word_bits].test(single(id % word_bits)); }
+
+    //--Acquire/release--
+    //a free id, npos if there is none. Each thread searches from its own starting point, see thread_hint.
+    std::size_t acquire() noexcept
+    {
+        if (leaves.empty()) return npos;
+        std::size_t& hint = thread_hint();
+        const std::size_t id = acquire_near(hint == npos ? spread_hint() : hint);
+        if (id != npos) hint = id + 1;
+        return id;
+    }
+    //the first free id at or after hint in hint's leaf, then in the leaves after it, wrapping round to the
+    //first leaf. npos if there is none.
+    std::size_t acquire_near(std::size_t hint) noexcept
+    {
+        const std::size_t n = leaves.size();
+        if (n == 0) return npos;
+        if (hint >= id_count) hint %= id_count;
+        std::size_t i = hint / word_bits, id = claim(i, hint % word_bits);
+        for (std::size_t visited = 1; id == npos && visited < n;)
+        {
+            i = i + 1 == n ? 0 : i + 1;
+            const std::size_t s = i / word_bits;
+            const word_t open = static_cast<word_t>(~traits::to_word(summary[s].load()) & (ones << (i % word_bits)));
+            if (open == 0)
+            {
+                //the rest of this summary word is full leaves
+                const std::size_t skip = std::min((s + 1) * word_bits, n) - i;
+                visited += skip;
+                i += skip - 1;
+                continue;
+            }
+            const std::size_t j = s * word_bits + bitfield_detail::countr_zero(open);
+            visited += j - i + 1;
+            i = j;
+            id = claim(j, 0);
+        }
+        return id;
+    }
+    //frees an id given by acquire
+    void release(const std::size_t id) noexcept
+    {
+        assert(id < id_count);
+        const std::size_t leaf = id / word_bits;
+        const word_t prev = traits::to_word(leaves[leaf].fetch_and(all_but(id % word_bits)));
+        assert(((prev >> (id % word_bits)) & 1) != 0);
+        if (prev == ones) mark_open(leaf);
+    }
+    //frees n ids, with one atomic operation for each run of ids in the same leaf - sort them for the fewest
+    void release_batch(const std::size_t* ids, const std::size_t n) noexcept
+    {
+        for (std::size_t k = 0; k < n;)
+        {
+            const std::size_t leaf = ids[k] / word_bits;
+            word_t m = 0;
+            for (; k < n && ids[k] / word_bits == leaf; ++k)
+            {
+                assert(ids[k] < id_count);
+                m |= static_cast<word_t>(word_t(1) << (ids[k] % word_bits));
+            }
+            const word_t prev = traits::to_word(leaves[leaf].fetch_and(traits::to_field(static_cast<word_t>(~m))));
+            assert((prev & m) == m);
+            if (prev == ones) mark_open(leaf);
+        }
+    }
+};
+
+//id allocator type declaration using the words of a BIT_FIELD as leaves - BIT_ALLOCATOR(mybitfield, myallocator);
+#define BIT_ALLOCATOR( bitfield_t, allocator_t ) typedef checked_bit_allocator<bitfield_t> allocator_t
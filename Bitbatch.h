@@ -0,0 +1,303 @@
+/*Copyright 2017 Jonathan Campbell
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.*/
+//batch mask evaluation over arrays of BIT_FIELD records
+#pragma once
+#include "Bitfield.h"
+#if defined(__has_include) && (__cplusplus >= 202002L || (defined(_MSVC_LANG) && _MSVC_LANG >= 202002L))
+#if __has_include(<span>) && __has_include(<ranges>)
+#include <ranges>
+#include <span>
+#endif
+#endif
+
+//how a record is tested against a mask
+enum class bitfield_match
+{
+    any,  //(field & mask) != nullptr
+    all,  //(field & mask) == mask
+    none  //(field & mask) == nullptr
+};
+
+namespace bitfield_detail
+{
+    template <bitfield_match match, typename word_t>
+    constexpr bool matches(const word_t w, const word_t m) noexcept
+    {
+        return match == bitfield_match::any ? (w & m) != 0 : (match == bitfield_match::all ? (w & m) == m : (w & m) == 0);
+    }
+
+    //number of records a vector kernel tests at once, 1 when there is no kernel for the word size
+    template <typename word_t>
+    constexpr std::size_t batch_lanes() noexcept
+    {
+    #if defined(BITFIELD_AVX512)
+        return (sizeof(word_t) == 8 || sizeof(word_t) == 4) ? 64 / sizeof(word_t) : 1;
+    #elif defined(BITFIELD_AVX2)
+        return (sizeof(word_t) == 8 || sizeof(word_t) == 4) ? 32 / sizeof(word_t) : 1;
+    #else
+        return 1;
+    #endif
+    }
+
+    //bit i of the result is set if record i of the block at p matches m, m holds the mask in every lane.
+    //Only called when batch_lanes<word_t>() > 1.
+#if defined(BITFIELD_AVX512)
+    typedef __m512i batch_vector;
+    template <typename word_t>
+    inline batch_vector batch_broadcast(const word_t m) noexcept
+    {
+        if constexpr (sizeof(word_t) == 8) return _mm512_set1_epi64(static_cast<long long>(m));
+        else return _mm512_set1_epi32(static_cast<int>(m));
+    }
+    template <bitfield_match match, typename word_t>
+    inline unsigned int batch_block(const word_t* p, const batch_vector m) noexcept
+    {
+        const __m512i v = _mm512_loadu_si512(p);
+        if constexpr (sizeof(word_t) == 8)
+        {
+            if constexpr (match == bitfield_match::any) return _mm512_test_epi64_mask(v, m);
+            else if constexpr (match == bitfield_match::none) return _mm512_testn_epi64_mask(v, m);
+            else return _mm512_cmpeq_epi64_mask(_mm512_and_si512(v, m), m);
+        }
+        else
+        {
+            if constexpr (match == bitfield_match::any) return _mm512_test_epi32_mask(v, m);
+            else if constexpr (match == bitfield_match::none) return _mm512_testn_epi32_mask(v, m);
+            else return _mm512_cmpeq_epi32_mask(_mm512_and_si512(v, m), m);
+        }
+    }
+#elif defined(BITFIELD_AVX2)
+    typedef __m256i batch_vector;
+    template <typename word_t>
+    inline batch_vector batch_broadcast(const word_t m) noexcept
+    {
+        if constexpr (sizeof(word_t) == 8) return _mm256_set1_epi64x(static_cast<long long>(m));
+        else return _mm256_set1_epi32(static_cast<int>(m));
+    }
+    template <bitfield_match match, typename word_t>
+    inline unsigned int batch_block(const word_t* p, const batch_vector m) noexcept
+    {
+        const __m256i t = _mm256_and_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)), m);
+        const __m256i cmp = match == bitfield_match::all ? m : _mm256_setzero_si256();
+        unsigned int equal;
+        if constexpr (sizeof(word_t) == 8) equal = static_cast<unsigned int>(_mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(t, cmp))));
+        else equal = static_cast<unsigned int>(_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(t, cmp))));
+        return match == bitfield_match::any ? ~equal & ((1u << batch_lanes<word_t>()) - 1) : equal;
+    }
+#endif
+
+    template <bitfield_match match, typename word_t>
+    std::size_t count_matching(const word_t* w, const std::size_t n, const word_t m) noexcept
+    {
+        std::size_t i = 0, count = 0;
+    #if defined(BITFIELD_AVX512) || defined(BITFIELD_AVX2)
+        if constexpr (batch_lanes<word_t>() > 1)
+        {
+            const batch_vector vm = batch_broadcast(m);
+            for (const std::size_t body = n - n % batch_lanes<word_t>(); i < body; i += batch_lanes<word_t>())
+                count += popcount(batch_block<match>(w + i, vm));
+        }
+    #endif
+        for (; i < n; ++i) count += matches<match>(w[i], m);
+        return count;
+    }
+
+    template <bitfield_match match, typename word_t>
+    bool any_matching(const word_t* w, const std::size_t n, const word_t m) noexcept
+    {
+        std::size_t i = 0;
+    #if defined(BITFIELD_AVX512) || defined(BITFIELD_AVX2)
+        if constexpr (batch_lanes<word_t>() > 1)
+        {
+            const batch_vector vm = batch_broadcast(m);
+            for (const std::size_t body = n - n % batch_lanes<word_t>(); i < body; i += batch_lanes<word_t>())
+                if (batch_block<match>(w + i, vm) != 0) return true;
+        }
+    #endif
+        for (; i < n; ++i)
+            if (matches<match>(w[i], m)) return true;
+        return false;
+    }
+
+    template <bitfield_match match, typename word_t>
+    std::size_t filter_indices(const word_t* w, const std::size_t n, const word_t m, std::size_t* out) noexcept
+    {
+        std::size_t i = 0, found = 0;
+    #if defined(BITFIELD_AVX512) || defined(BITFIELD_AVX2)
+        if constexpr (batch_lanes<word_t>() > 1)
+        {
+            const batch_vector vm = batch_broadcast(m);
+            const std::size_t body = n - n % batch_lanes<word_t>();
+        #if defined(BITFIELD_AVX512)
+            if constexpr (sizeof(std::size_t) == 8)
+            {
+                //compress-store the matching indices, 8 at a time
+                const __m512i iota = _mm512_set_epi64(7, 6, 5, 4, 3, 2, 1, 0);
+                for (; i < body; i += batch_lanes<word_t>())
+                {
+                    const unsigned int hits = batch_block<match>(w + i, vm);
+                    for (std::size_t lane = 0; lane < batch_lanes<word_t>(); lane += 8)
+                    {
+                        const __mmask8 k = static_cast<__mmask8>(hits >> lane);
+                        _mm512_mask_compressstoreu_epi64(out + found, k, _mm512_add_epi64(iota, _mm512_set1_epi64(static_cast<long long>(i + lane))));
+                        found += popcount(static_cast<unsigned int>(k));
+                    }
+                }
+            }
+        #endif
+            for (; i < body; i += batch_lanes<word_t>())
+                for (unsigned int hits = batch_block<match>(w + i, vm); hits != 0; hits &= hits - 1)
+                    out[found++] = i + countr_zero(hits);
+        }
+    #endif
+        //branchless - always write, only advance on a match
+        for (; i < n; ++i)
+        {
+            out[found] = i;
+            found += matches<match>(w[i], m);
+        }
+        return found;
+    }
+
+    //m repeated in each word of 64 bits, to broadcast it to every lane of a vector
+    template <typename word_t>
+    constexpr long long batch_splat(const word_t m) noexcept
+    {
+        std::uint64_t r = static_cast<typename std::make_unsigned<word_t>::type>(m);
+        for (std::size_t s = 8 * sizeof(word_t); s < 64; s *= 2) r |= r << s;
+        return static_cast<long long>(r);
+    }
+
+    //w[i] = op(w[i], m) for the n words, a vector at a time as in wide_apply with m in every lane.
+    //Each step is a multiple of the next one, so n - n % step ends the whole vectors at every width.
+    template <typename op, typename word_t>
+    void bulk_apply(word_t* w, const std::size_t n, const word_t m) noexcept
+    {
+        std::size_t i = 0;
+    #ifdef BITFIELD_AVX512
+        {
+            constexpr std::size_t step = 64 / sizeof(word_t);
+            const __m512i vm = _mm512_set1_epi64(batch_splat(m));
+            for (const std::size_t body = n - n % step; i < body; i += step)
+                _mm512_storeu_si512(w + i, op::v512(_mm512_loadu_si512(w + i), vm));
+        }
+    #endif
+    #ifdef BITFIELD_AVX2
+        {
+            constexpr std::size_t step = 32 / sizeof(word_t);
+            const __m256i vm = _mm256_set1_epi64x(batch_splat(m));
+            for (const std::size_t body = n - n % step; i < body; i += step)
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(w + i), op::v256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(w + i)), vm));
+        }
+    #endif
+    #ifdef BITFIELD_SSE2
+        {
+            constexpr std::size_t step = 16 / sizeof(word_t);
+            const __m128i vm = _mm_set1_epi64x(batch_splat(m));
+            for (const std::size_t body = n - n % step; i < body; i += step)
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(w + i), op::v128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(w + i)), vm));
+        }
+    #endif
+        for (; i < n; ++i) w[i] = op::template scalar<word_t>(w[i], m);
+    }
+}
+
+//--Batch queries--
+//number of records that match mask
+template <typename field_type>
+std::size_t count_matching(const field_type* records, const std::size_t n, const typename bitfield_traits<field_type>::field_t& mask, const bitfield_match match = bitfield_match::all) noexcept
+{
+    typedef bitfield_traits<field_type> traits;
+    const typename traits::word_t* w = traits::to_words(records);
+    switch (match)
+    {
+    case bitfield_match::any: return bitfield_detail::count_matching<bitfield_match::any>(w, n, traits::to_word(mask));
+    case bitfield_match::none: return bitfield_detail::count_matching<bitfield_match::none>(w, n, traits::to_word(mask));
+    default: return bitfield_detail::count_matching<bitfield_match::all>(w, n, traits::to_word(mask));
+    }
+}
+//true if any record matches mask, stops at the first block with a match
+template <typename field_type>
+bool any_matching(const field_type* records, const std::size_t n, const typename bitfield_traits<field_type>::field_t& mask, const bitfield_match match = bitfield_match::all) noexcept
+{
+    typedef bitfield_traits<field_type> traits;
+    const typename traits::word_t* w = traits::to_words(records);
+    switch (match)
+    {
+    case bitfield_match::any: return bitfield_detail::any_matching<bitfield_match::any>(w, n, traits::to_word(mask));
+    case bitfield_match::none: return bitfield_detail::any_matching<bitfield_match::none>(w, n, traits::to_word(mask));
+    default: return bitfield_detail::any_matching<bitfield_match::all>(w, n, traits::to_word(mask));
+    }
+}
+//writes the indices of the matching records to out, in order, and returns how many there were.
+//out must have room for n indices.
+template <typename field_type>
+std::size_t filter_indices(const field_type* records, const std::size_t n, const typename bitfield_traits<field_type>::field_t& mask, std::size_t* out, const bitfield_match match = bitfield_match::all) noexcept
+{
+    typedef bitfield_traits<field_type> traits;
+    const typename traits::word_t* w = traits::to_words(records);
+    switch (match)
+    {
+    case bitfield_match::any: return bitfield_detail::filter_indices<bitfield_match::any>(w, n, traits::to_word(mask), out);
+    case bitfield_match::none: return bitfield_detail::filter_indices<bitfield_match::none>(w, n, traits::to_word(mask), out);
+    default: return bitfield_detail::filter_indices<bitfield_match::all>(w, n, traits::to_word(mask), out);
+    }
+}
+
+//--Batch updates--
+//records[i] |= mask / records[i] &= mask for every record
+template <typename field_type>
+void bulk_or(field_type* records, const std::size_t n, const typename bitfield_traits<field_type>::field_t& mask) noexcept
+{
+    typedef bitfield_traits<field_type> traits;
+    bitfield_detail::bulk_apply<bitfield_detail::op_or>(traits::to_words(records), n, traits::to_word(mask));
+}
+template <typename field_type>
+void bulk_and(field_type* records, const std::size_t n, const typename bitfield_traits<field_type>::field_t& mask) noexcept
+{
+    typedef bitfield_traits<field_type> traits;
+    bitfield_detail::bulk_apply<bitfield_detail::op_and>(traits::to_words(records), n, traits::to_word(mask));
+}
+
+#if defined(__cpp_lib_span) && defined(__cpp_lib_ranges)
+//range forms of the batch functions, for std::span, std::vector, std::array and any other contiguous range of
+//records. The field type comes from the range, so the mask may be a fieldbit_t or a field of that type.
+template <typename range_t>
+using bitfield_range_field_t = typename bitfield_traits<std::ranges::range_value_t<range_t>>::field_t;
+template <typename range_t>
+concept bitfield_record_range = std::ranges::contiguous_range<range_t> && std::ranges::sized_range<range_t>;
+
+template <bitfield_record_range range_t>
+std::size_t count_matching(range_t&& records, const bitfield_range_field_t<range_t>& mask, const bitfield_match match = bitfield_match::all) noexcept
+{
+    return count_matching(std::ranges::data(records), std::ranges::size(records), mask, match);
+}
+template <bitfield_record_range range_t>
+bool any_matching(range_t&& records, const bitfield_range_field_t<range_t>& mask, const bitfield_match match = bitfield_match::all) noexcept
+{
+    return any_matching(std::ranges::data(records), std::ranges::size(records), mask, match);
+}
+//out must be at least as long as records, returns the number of indices written
+template <bitfield_record_range range_t>
+std::size_t filter_indices(range_t&& records, const bitfield_range_field_t<range_t>& mask, const std::span<std::size_t> out, const bitfield_match match = bitfield_match::all) noexcept
+{
+    assert(out.size() >= std::ranges::size(records));
+    return filter_indices(std::ranges::data(records), std::ranges::size(records), mask, out.data(), match);
+}
+//records must not be const
+template <bitfield_record_range range_t>
+void bulk_or(range_t&& records, const bitfield_range_field_t<range_t>& mask) noexcept { bulk_or(std::ranges::data(records), std::ranges::size(records), mask); }
+template <bitfield_record_range range_t>
+void bulk_and(range_t&& records, const bitfield_range_field_t<range_t>& mask) noexcept { bulk_and(std::ranges::data(records), std::ranges::size(records), mask); }
+#endif
@@ -14,9 +14,421 @@ limitations under the License.*/
 //this was inspired from http://www.artima.com/cppsource/safelabels.html
 #pragma once
 #include <assert.h>
-#ifdef _BITFIELD
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+//vector and bit manipulation instruction sets used by the kernels, picked at compile time.
+//Define BITFIELD_NO_SIMD to force the scalar fallback.
+#ifndef BITFIELD_NO_SIMD
+#if defined(__AVX512F__)
+#define BITFIELD_AVX512 1
+#endif
+#if defined(__AVX2__)
+#define BITFIELD_AVX2 1
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define BITFIELD_SSE2 1
+#endif
+#if defined(__x86_64__) || defined(_M_X64)
+//every AVX2 capable CPU has BMI1/BMI2, MSVC only tells us about AVX2
+#if defined(__BMI__) || (defined(_MSC_VER) && defined(__AVX2__))
+#define BITFIELD_BMI 1
+#endif
+#if defined(__BMI2__) || (defined(_MSC_VER) && defined(__AVX2__))
+#define BITFIELD_BMI2 1
+#endif
+#endif
+#endif
+#if defined(BITFIELD_AVX512) || defined(BITFIELD_AVX2) || defined(BITFIELD_SSE2) || defined(BITFIELD_BMI) || defined(BITFIELD_BMI2)
+#include <immintrin.h>
+#endif
+#if defined(__has_include) && (__cplusplus >= 202002L || (defined(_MSVC_LANG) && _MSVC_LANG >= 202002L))
+#if __has_include(<bit>)
+#include <bit>
+#endif
+#endif
+
+//_BITFIELD_INSTRUMENT counts the set, clear and test accesses to each bit of every checked_bit_field type, see
+//bitfield_instrument. It needs the checked types, so it turns on _BITFIELD.
+#ifdef _BITFIELD_INSTRUMENT
+#ifndef _BITFIELD
+#define _BITFIELD
+#endif
+#include <array>
+#include <cstdio>
+#include <mutex>
+#include <vector>
+//true while the compiler evaluates a constant expression, the counters are only touched at run time
+#if defined(__cpp_lib_is_constant_evaluated)
+#define BITFIELD_CONSTANT_EVALUATED() std::is_constant_evaluated()
+#elif defined(_MSC_VER) && _MSC_VER >= 1925
+#define BITFIELD_CONSTANT_EVALUATED() __builtin_is_constant_evaluated()
+#elif defined(__has_builtin)
+#if __has_builtin(__builtin_is_constant_evaluated)
+#define BITFIELD_CONSTANT_EVALUATED() __builtin_is_constant_evaluated()
+#endif
+#endif
+#ifndef BITFIELD_CONSTANT_EVALUATED
+#define BITFIELD_CONSTANT_EVALUATED() false
+#endif
+#endif
+
 //used to create a unique id for the template
 struct bitfield_unique_id {};
+//shared id for types that have no plain integer equivalent when _BITFIELD is not defined
+inline bitfield_unique_id bitfield_unchecked_id;
+
+//bitfield_traits lets generic code (the atomic field, containers) work with both a checked_bit_field and the plain
+//integer BIT_FIELD declares when _BITFIELD is not defined. to_field/to_fieldbit bypass the type checking and are
+//meant for code that already holds a word of the right field.
+template <typename field_type>
+struct bitfield_traits
+{
+    static_assert(std::is_integral<field_type>::value, "bitfield_traits needs a BIT_FIELD type");
+    typedef field_type word_t;
+    typedef field_type field_t;
+    typedef field_type fieldbit_t;
+    static constexpr bitfield_unique_id* unique_id = &bitfield_unchecked_id;
+
+    static constexpr word_t to_word(const field_t f) noexcept { return f; }
+    static constexpr field_t to_field(const word_t w) noexcept { return w; }
+    static constexpr fieldbit_t to_fieldbit(const word_t w) noexcept { return w; }
+    //views an array of fields as its words and back, for the bulk kernels
+    static const word_t* to_words(const field_t* f) noexcept { return f; }
+    static word_t* to_words(field_t* f) noexcept { return f; }
+    static const field_t* to_fields(const word_t* w) noexcept { return w; }
+    static field_t* to_fields(word_t* w) noexcept { return w; }
+};
+
+namespace bitfield_detail
+{
+    //single word bit queries. These use <bit> when available and the compiler builtins otherwise, so they
+    //compile to popcnt/tzcnt/lzcnt when the target has them.
+    template <typename word_t>
+    constexpr unsigned int popcount(const word_t w) noexcept
+    {
+        typedef typename std::make_unsigned<word_t>::type uword_t;
+        const uword_t u = static_cast<uword_t>(w);
+    #if defined(__cpp_lib_bitops)
+        return static_cast<unsigned int>(std::popcount(u));
+    #elif defined(__GNUC__) || defined(__clang__)
+        return sizeof(uword_t) <= sizeof(unsigned int) ? static_cast<unsigned int>(__builtin_popcount(u)) : static_cast<unsigned int>(__builtin_popcountll(u));
+    #else
+        unsigned int n = 0;
+        for (uword_t v = u; v != 0; v &= v - 1) ++n;
+        return n;
+    #endif
+    }
+    //number of zero bits below the lowest set bit, w must not be zero
+    template <typename word_t>
+    constexpr unsigned int countr_zero(const word_t w) noexcept
+    {
+        typedef typename std::make_unsigned<word_t>::type uword_t;
+        const uword_t u = static_cast<uword_t>(w);
+    #if defined(__cpp_lib_bitops)
+        return static_cast<unsigned int>(std::countr_zero(u));
+    #elif defined(__GNUC__) || defined(__clang__)
+        return sizeof(uword_t) <= sizeof(unsigned int) ? static_cast<unsigned int>(__builtin_ctz(u)) : static_cast<unsigned int>(__builtin_ctzll(u));
+    #else
+        unsigned int n = 0;
+        for (uword_t v = u; (v & 1) == 0; v >>= 1) ++n;
+        return n;
+    #endif
+    }
+    //number of zero bits above the highest set bit, w must not be zero
+    template <typename word_t>
+    constexpr unsigned int countl_zero(const word_t w) noexcept
+    {
+        typedef typename std::make_unsigned<word_t>::type uword_t;
+        const uword_t u = static_cast<uword_t>(w);
+    #if defined(__cpp_lib_bitops)
+        return static_cast<unsigned int>(std::countl_zero(u));
+    #elif defined(__GNUC__) || defined(__clang__)
+        return sizeof(uword_t) <= sizeof(unsigned int) ? static_cast<unsigned int>(__builtin_clz(u)) - 8 * static_cast<unsigned int>(sizeof(unsigned int) - sizeof(uword_t)) :
+            static_cast<unsigned int>(__builtin_clzll(u)) - 8 * static_cast<unsigned int>(sizeof(unsigned long long) - sizeof(uword_t));
+    #else
+        unsigned int n = 0;
+        for (uword_t v = u; (v & (uword_t(1) << (8 * sizeof(uword_t) - 1))) == 0; v <<= 1) ++n;
+        return n;
+    #endif
+    }
+    //position of the lowest/highest set bit numbered from 1 as in set_bit, 0 if no bit is set (like ffs)
+    template <typename word_t>
+    constexpr unsigned int first_set(const word_t w) noexcept { return w == 0 ? 0 : countr_zero(w) + 1; }
+    template <typename word_t>
+    constexpr unsigned int last_set(const word_t w) noexcept { return w == 0 ? 0 : 8 * static_cast<unsigned int>(sizeof(word_t)) - countl_zero(w); }
+}
+
+//iterates over the set bits of a field, lowest first, yielding a fieldbit_t with just that bit set
+template <typename field_type>
+class bitfield_bit_iterator
+{
+public:
+    typedef bitfield_traits<field_type> traits;
+    typedef typename traits::fieldbit_t fieldbit_t;
+    typedef typename std::make_unsigned<typename traits::word_t>::type uword_t;
+
+    typedef std::forward_iterator_tag iterator_category;
+    typedef fieldbit_t value_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef void pointer;
+    typedef fieldbit_t reference;
+
+private:
+    //the bits not yet visited
+    uword_t rest;
+
+public:
+    constexpr explicit bitfield_bit_iterator(const uword_t bits = 0) noexcept : rest(bits) {}
+
+    fieldbit_t operator*() const noexcept { return traits::to_fieldbit(static_cast<typename traits::word_t>(rest & (~rest + 1))); }
+    //position of the current bit, numbered from 1 as in set_bit
+    constexpr unsigned int position() const noexcept { return bitfield_detail::first_set(rest); }
+
+    constexpr bitfield_bit_iterator& operator++() noexcept { rest &= rest - 1; return *this; }
+    constexpr bitfield_bit_iterator operator++(int) noexcept { bitfield_bit_iterator old = *this; rest &= rest - 1; return old; }
+    constexpr bool operator==(const bitfield_bit_iterator& rhs) const noexcept { return rest == rhs.rest; }
+    constexpr bool operator!=(const bitfield_bit_iterator& rhs) const noexcept { return rest != rhs.rest; }
+};
+
+template <typename field_type>
+class bitfield_bit_range
+{
+public:
+    typedef bitfield_bit_iterator<field_type> iterator;
+
+private:
+    typename iterator::uword_t bits;
+
+public:
+    constexpr explicit bitfield_bit_range(const typename iterator::uword_t init) noexcept : bits(init) {}
+    constexpr iterator begin() const noexcept { return iterator(bits); }
+    constexpr iterator end() const noexcept { return iterator(); }
+};
+
+#ifdef _BITFIELD_INSTRUMENT
+//kinds of access counted for each bit
+enum class bitfield_access
+{
+    set,        //turned on by an assignment, = or a compound assignment
+    clear,      //turned off by an assignment
+    test        //named by the mask of &, any, all or none
+};
+
+//format of bitfield_instrument::dump
+enum class bitfield_dump_format
+{
+    text,
+    json
+};
+
+//merged counts of one field type, indexed by bit position - 1 (set_bit numbering)
+template <std::size_t bits>
+struct bitfield_access_counts
+{
+    std::array<std::uint64_t, bits> set;
+    std::array<std::uint64_t, bits> clear;
+    std::array<std::uint64_t, bits> test;
+};
+
+//Access counters of one BIT_FIELD type. Each thread counts into its own block, aligned to cache lines so threads
+//never share a line, and with relaxed loads and stores rather than atomic increments - only the owning thread
+//writes a block. snapshot adds up the blocks of the running threads and those folded in by threads that exited.
+//The counts tell which bits are hot enough to share a word and which are never tested. An assignment counts the
+//bits it changes, so x &= ~MASK counts only the bits of MASK that were on. Copies of a whole field stay trivial
+//and aren't counted, nor are the atomic field and the containers, which work on the words directly. Masks
+//declared with BIT_MASK give the bits their labels.
+template <typename field_type>
+class bitfield_instrument
+{
+public:
+    typedef bitfield_traits<field_type> traits;
+    typedef typename traits::word_t word_t;
+    static constexpr std::size_t bits = 8 * sizeof(word_t);
+    typedef bitfield_access_counts<bits> counts_t;
+
+private:
+    typedef typename std::make_unsigned<word_t>::type uword_t;
+
+    struct alignas(64) counters
+    {
+        std::atomic<std::uint64_t> counts[3][bits];
+        counters() noexcept
+        {
+            for (auto& access : counts)
+                for (std::atomic<std::uint64_t>& c : access) c.store(0, std::memory_order_relaxed);
+        }
+        void add(const bitfield_access access, uword_t w) noexcept
+        {
+            std::atomic<std::uint64_t>* const c = counts[static_cast<int>(access)];
+            for (; w != 0; w &= w - 1)
+            {
+                std::atomic<std::uint64_t>& n = c[bitfield_detail::countr_zero(w)];
+                n.store(n.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            }
+        }
+    };
+
+    struct registry
+    {
+        std::mutex lock;
+        std::vector<counters*> live;
+        counts_t retired = {};
+        const char* labels[bits] = {};
+    };
+    static registry& shared()
+    {
+        static registry r;
+        return r;
+    }
+
+    //the calling thread's block, registered while the thread runs
+    struct thread_counters : counters
+    {
+        thread_counters()
+        {
+            registry& r = shared();
+            std::lock_guard<std::mutex> guard(r.lock);
+            r.live.push_back(this);
+        }
+        ~thread_counters()
+        {
+            registry& r = shared();
+            std::lock_guard<std::mutex> guard(r.lock);
+            add_to(r.retired, *this);
+            for (std::size_t i = 0; i < r.live.size(); ++i)
+                if (r.live[i] == this)
+                {
+                    r.live[i] = r.live.back();
+                    r.live.pop_back();
+                    break;
+                }
+        }
+    };
+    static counters& local()
+    {
+        static thread_local thread_counters c;
+        return c;
+    }
+
+    static void add_to(counts_t& sum, const counters& c) noexcept
+    {
+        for (std::size_t b = 0; b < bits; ++b)
+        {
+            sum.set[b] += c.counts[static_cast<int>(bitfield_access::set)][b].load(std::memory_order_relaxed);
+            sum.clear[b] += c.counts[static_cast<int>(bitfield_access::clear)][b].load(std::memory_order_relaxed);
+            sum.test[b] += c.counts[static_cast<int>(bitfield_access::test)][b].load(std::memory_order_relaxed);
+        }
+    }
+
+public:
+    //counts one access to each bit set in w, called by the checked_bit_field operators
+    static constexpr void record(const bitfield_access access, const word_t w) noexcept
+    {
+        if (BITFIELD_CONSTANT_EVALUATED() || w == 0) return;
+        local().add(access, static_cast<uword_t>(w));
+    }
+    //counts the bits an assignment turns on and off, from the word before and after it
+    static constexpr void record_change(const word_t before, const word_t after) noexcept
+    {
+        record(bitfield_access::set, static_cast<word_t>(after & ~before));
+        record(bitfield_access::clear, static_cast<word_t>(before & ~after));
+    }
+    //names bit pos (numbered from 1 as in set_bit) in dumps, the first label given to a bit is kept
+    static void label(const unsigned int pos, const char* name)
+    {
+        if (pos == 0 || pos > bits) return;
+        registry& r = shared();
+        std::lock_guard<std::mutex> guard(r.lock);
+        if (r.labels[pos - 1] == nullptr) r.labels[pos - 1] = name;
+    }
+    static const char* label(const unsigned int pos)
+    {
+        if (pos == 0 || pos > bits) return nullptr;
+        registry& r = shared();
+        std::lock_guard<std::mutex> guard(r.lock);
+        return r.labels[pos - 1];
+    }
+
+    //the counts of all threads so far. Running threads keep counting, so it is a close snapshot rather than an exact one.
+    static counts_t snapshot()
+    {
+        registry& r = shared();
+        std::lock_guard<std::mutex> guard(r.lock);
+        counts_t sum = r.retired;
+        for (const counters* c : r.live) add_to(sum, *c);
+        return sum;
+    }
+    //zeroes the counts, accesses made by other threads at the same time may survive
+    static void reset()
+    {
+        registry& r = shared();
+        std::lock_guard<std::mutex> guard(r.lock);
+        r.retired = counts_t{};
+        for (const counters* c : r.live)
+            for (auto& access : const_cast<counters*>(c)->counts)
+                for (std::atomic<std::uint64_t>& n : access) n.store(0, std::memory_order_relaxed);
+    }
+
+    //writes the snapshot to out, one row for each bit that has a label or has been accessed. name is the field type.
+    static void dump(std::FILE* out, const char* name, const bitfield_dump_format format = bitfield_dump_format::text)
+    {
+        const counts_t c = snapshot();
+        const char* names[bits];
+        {
+            registry& r = shared();
+            std::lock_guard<std::mutex> guard(r.lock);
+            for (std::size_t b = 0; b < bits; ++b) names[b] = r.labels[b];
+        }
+        const bool json = format == bitfield_dump_format::json;
+        if (json) std::fprintf(out, "{\"field\":\"%s\",\"bits\":[", name);
+        else std::fprintf(out, "%s\n%5s  %-24s %20s %20s %20s\n", name, "bit", "label", "set", "clear", "test");
+        bool first = true;
+        for (std::size_t b = 0; b < bits; ++b)
+        {
+            if (names[b] == nullptr && c.set[b] == 0 && c.clear[b] == 0 && c.test[b] == 0) continue;
+            const unsigned long long set = c.set[b], clear = c.clear[b], test = c.test[b];
+            if (json)
+            {
+                std::fprintf(out, "%s{\"bit\":%u,\"label\":", first ? "" : ",", static_cast<unsigned int>(b + 1));
+                if (names[b] != nullptr) std::fprintf(out, "\"%s\"", names[b]);
+                else std::fputs("null", out);
+                std::fprintf(out, ",\"set\":%llu,\"clear\":%llu,\"test\":%llu}", set, clear, test);
+            }
+            else std::fprintf(out, "%5u  %-24s %20llu %20llu %20llu\n", static_cast<unsigned int>(b + 1), names[b] != nullptr ? names[b] : "-", set, clear, test);
+            first = false;
+        }
+        if (json) std::fputs("]}\n", out);
+    }
+};
+
+//the mask of an instrumented BIT_MASK, which also registers its label. name_t is a struct declared with the
+//mask, a local class when the mask is in a function, so it works wherever a plain BIT_MASK does. mask takes
+//the address of registered, which instantiates it, and its initializer registers the label at start up.
+template <typename field_type, unsigned int pos, typename name_t>
+struct bitfield_instrument_label
+{
+    static const bool registered;
+    static constexpr typename field_type::fieldbit_t mask() noexcept { return static_cast<void>(&registered), field_type::fieldbit_t::template set_bit<pos>(); }
+};
+template <typename field_type, unsigned int pos, typename name_t>
+const bool bitfield_instrument_label<field_type, pos, name_t>::registered = (bitfield_instrument<field_type>::label(pos, name_t::name()), true);
+
+//counts an access from inside the checked types, nothing is evaluated when _BITFIELD_INSTRUMENT is not defined
+#define BITFIELD_RECORD( field_type, access, w ) bitfield_instrument<field_type>::record(bitfield_access::access, static_cast<word_t>(w))
+#define BITFIELD_RECORD_CHANGE( field_type, before, after ) bitfield_instrument<field_type>::record_change(static_cast<word_t>(before), static_cast<word_t>(after))
+#else
+#define BITFIELD_RECORD( field_type, access, w ) static_cast<void>(0)
+#define BITFIELD_RECORD_CHANGE( field_type, before, after ) static_cast<void>(0)
+#endif
+
+#ifdef _BITFIELD
 
 //forward declaration of checked_bit_mask
 //word_t type of "word" to store the bits - should be an integer type
@@ -25,6 +437,9 @@ template <bitfield_unique_id* unique_id, typename word_t>
 class checked_bit_mask;
 
 //class declaration
+//the volatile overloads only make each access volatile, a read-modify-write such as |= is not atomic.
+//Use checked_atomic_bit_field for fields shared between threads. Assignments to a volatile field return
+//void, as the built-in volatile compound assignments do since C++20, so a statement doesn't read it back.
 template <bitfield_unique_id* unique_id, typename word_t>
 class checked_bit_field
 {
@@ -33,52 +448,55 @@ private:
     word_t word;
 
     //private constructor from an integer type.
-    explicit checked_bit_field(word_t init) noexcept : word(init) {}
+    constexpr explicit checked_bit_field(word_t init) noexcept : word(init) {}
+
+    //enables the volatile copy and assignment templates for this type only. As templates they aren't copy
+    //constructors or copy assignments, which keeps checked_bit_field trivially copyable.
+    template <typename rhs_t>
+    using if_field = typename std::enable_if<std::is_same<rhs_t, checked_bit_field>::value, int>::type;
 
 public:
     //For convenience with macros, we declare checked_bit_field::fieldbit_t
     friend class checked_bit_mask<unique_id, word_t>;
+    friend struct bitfield_traits<checked_bit_field>;
     typedef checked_bit_mask<unique_id, word_t> fieldbit_t;
 
     //--Constructors--
     //default constructor - our "word" is zeroed
-    checked_bit_field() noexcept : word(static_cast<word_t>(0)) {}
+    constexpr checked_bit_field() noexcept : word(static_cast<word_t>(0)) {}
     //copy constructor from bitfield
-    checked_bit_field(const checked_bit_field& rhs) noexcept : word(rhs.word) {}
-    checked_bit_field(const volatile checked_bit_field& rhs) noexcept : word(rhs.word) {}
+    constexpr checked_bit_field(const checked_bit_field&) noexcept = default;
+    template <typename rhs_t, if_field<rhs_t> = 0>
+    checked_bit_field(const volatile rhs_t& rhs) noexcept : word(rhs.word) {}
     //copy constructor from bit mask
-    checked_bit_field(const fieldbit_t& rhs) noexcept : word(rhs.word) {}
+    constexpr checked_bit_field(const fieldbit_t& rhs) noexcept : word(rhs.word) {}
     //copy constructor from 0//NULL/nullptr
-    checked_bit_field(const std::nullptr_t)  noexcept : word(word_t{ 0 }) {}
+    constexpr checked_bit_field(const std::nullptr_t)  noexcept : word(word_t{ 0 }) {}
 
     //--Copy Assignments--
     //copy assignment operator
-    #ifdef _MSC_VER
-    //If you define or =delete any default operation, define or =delete them all
-    #pragma warning(suppress : 26432)
-    #endif
-    checked_bit_field& operator=(const checked_bit_field& rhs) noexcept { if (this != &rhs) word = rhs.word; return *this; }
-    volatile checked_bit_field& operator=(const checked_bit_field& rhs) volatile noexcept { if (this != &rhs) word = rhs.word; return *this; }
-    #ifdef _MSC_VER
-        //If you define or =delete any default operation, define or =delete them all
-    #pragma warning(suppress : 26432)
-    #endif
-    volatile checked_bit_field& operator=(const volatile checked_bit_field& rhs) volatile noexcept { if (this != &rhs) word = rhs.word; return *this; }
+    constexpr checked_bit_field& operator=(const checked_bit_field&) noexcept = default;
+    template <typename rhs_t, if_field<rhs_t> = 0>
+    checked_bit_field& operator=(const volatile rhs_t& rhs) noexcept { word = rhs.word; return *this; }
+    template <typename rhs_t, if_field<rhs_t> = 0>
+    void operator=(const rhs_t& rhs) volatile noexcept { word = rhs.word; }
+    template <typename rhs_t, if_field<rhs_t> = 0>
+    void operator=(const volatile rhs_t& rhs) volatile noexcept { word = rhs.word; }
     //copy assignment operator from bit mask
-    checked_bit_field& operator=(const fieldbit_t& rhs) noexcept { word = rhs.word; return *this; }
-    volatile checked_bit_field& operator=(const fieldbit_t& rhs) volatile noexcept { word = rhs.word; return *this; }
+    constexpr checked_bit_field& operator=(const fieldbit_t& rhs) noexcept { BITFIELD_RECORD_CHANGE(checked_bit_field, word, rhs.word); word = rhs.word; return *this; }
+    void operator=(const fieldbit_t& rhs) volatile noexcept { BITFIELD_RECORD_CHANGE(checked_bit_field, word, rhs.word); word = rhs.word; }
     //assignment operator to allow for assigning 0 (clearing bits)
-    checked_bit_field& operator=(const std::nullptr_t&) noexcept { word = 0; return *this; }
-    volatile checked_bit_field& operator=(const std::nullptr_t&) volatile noexcept { word = 0; return *this; }
+    constexpr checked_bit_field& operator=(const std::nullptr_t&) noexcept { BITFIELD_RECORD_CHANGE(checked_bit_field, word, 0); word = 0; return *this; }
+    void operator=(const std::nullptr_t&) volatile noexcept { BITFIELD_RECORD_CHANGE(checked_bit_field, word, 0); word = 0; }
 
     //--Operations--
     //0/NULL/nullptr to bitfield comparison operators
-    friend bool operator==(const std::nullptr_t, const checked_bit_field& rhs) noexcept { return 0 == rhs.word; }
-    friend bool operator!=(const std::nullptr_t, const checked_bit_field& rhs) noexcept { return 0 != rhs.word; }
-    friend bool operator<=(const std::nullptr_t, const checked_bit_field& rhs) noexcept { return 0 <= rhs.word; }
-    friend bool operator>=(const std::nullptr_t, const checked_bit_field& rhs) noexcept { return 0 >= rhs.word; }
-    friend bool operator< (const std::nullptr_t, const checked_bit_field& rhs) noexcept { return 0 <  rhs.word; }
-    friend bool operator> (const std::nullptr_t, const checked_bit_field& rhs) noexcept { return 0 >  rhs.word; }
+    friend constexpr bool operator==(const std::nullptr_t, const checked_bit_field& rhs) noexcept { return 0 == rhs.word; }
+    friend constexpr bool operator!=(const std::nullptr_t, const checked_bit_field& rhs) noexcept { return 0 != rhs.word; }
+    friend constexpr bool operator<=(const std::nullptr_t, const checked_bit_field& rhs) noexcept { return 0 <= rhs.word; }
+    friend constexpr bool operator>=(const std::nullptr_t, const checked_bit_field& rhs) noexcept { return 0 >= rhs.word; }
+    friend constexpr bool operator< (const std::nullptr_t, const checked_bit_field& rhs) noexcept { return 0 <  rhs.word; }
+    friend constexpr bool operator> (const std::nullptr_t, const checked_bit_field& rhs) noexcept { return 0 >  rhs.word; }
     friend bool operator==(const std::nullptr_t, const volatile checked_bit_field& rhs) noexcept { return 0 == rhs.word; }
     friend bool operator!=(const std::nullptr_t, const volatile checked_bit_field& rhs) noexcept { return 0 != rhs.word; }
     friend bool operator<=(const std::nullptr_t, const volatile checked_bit_field& rhs) noexcept { return 0 <= rhs.word; }
@@ -86,19 +504,19 @@ public:
     friend bool operator< (const std::nullptr_t, const volatile checked_bit_field& rhs) noexcept { return 0 <  rhs.word; }
     friend bool operator> (const std::nullptr_t, const volatile checked_bit_field& rhs) noexcept { return 0 >  rhs.word; }
     //0/NULL/nullptr to bitfield bitwise operators
-    friend checked_bit_field  operator& (const std::nullptr_t, const checked_bit_field&) noexcept { return checked_bit_field(static_cast<word_t>(0)); }
-    friend checked_bit_field  operator| (const std::nullptr_t, const checked_bit_field& rhs) noexcept { return checked_bit_field(rhs.word); }
-    friend checked_bit_field  operator^ (const std::nullptr_t, const checked_bit_field& rhs) noexcept { return checked_bit_field(rhs.word); }
+    friend constexpr checked_bit_field  operator& (const std::nullptr_t, const checked_bit_field&) noexcept { return checked_bit_field(static_cast<word_t>(0)); }
+    friend constexpr checked_bit_field  operator| (const std::nullptr_t, const checked_bit_field& rhs) noexcept { return checked_bit_field(rhs.word); }
+    friend constexpr checked_bit_field  operator^ (const std::nullptr_t, const checked_bit_field& rhs) noexcept { return checked_bit_field(rhs.word); }
     friend checked_bit_field  operator& (const std::nullptr_t, const volatile checked_bit_field&) noexcept { return checked_bit_field(static_cast<word_t>(0)); }
     friend checked_bit_field  operator| (const std::nullptr_t, const volatile checked_bit_field& rhs) noexcept { return checked_bit_field(rhs.word); }
     friend checked_bit_field  operator^ (const std::nullptr_t, const volatile checked_bit_field& rhs) noexcept { return checked_bit_field(rhs.word); }
     //bitfield to 0/NULL/nullptr comparison operators
-    bool operator==(const std::nullptr_t) const noexcept { return word == 0; }
-    bool operator!=(const std::nullptr_t) const noexcept { return word != 0; }
-    bool operator<=(const std::nullptr_t) const noexcept { return word <= 0; }
-    bool operator>=(const std::nullptr_t) const noexcept { return word >= 0; }
-    bool operator< (const std::nullptr_t) const noexcept { return word < 0; }
-    bool operator> (const std::nullptr_t) const noexcept { return word > 0; }
+    constexpr bool operator==(const std::nullptr_t) const noexcept { return word == 0; }
+    constexpr bool operator!=(const std::nullptr_t) const noexcept { return word != 0; }
+    constexpr bool operator<=(const std::nullptr_t) const noexcept { return word <= 0; }
+    constexpr bool operator>=(const std::nullptr_t) const noexcept { return word >= 0; }
+    constexpr bool operator< (const std::nullptr_t) const noexcept { return word < 0; }
+    constexpr bool operator> (const std::nullptr_t) const noexcept { return word > 0; }
     bool operator==(const std::nullptr_t) const volatile noexcept { return word == 0; }
     bool operator!=(const std::nullptr_t) const volatile noexcept { return word != 0; }
     bool operator<=(const std::nullptr_t) const volatile noexcept { return word <= 0; }
@@ -106,25 +524,25 @@ public:
     bool operator< (const std::nullptr_t) const volatile noexcept { return word < 0; }
     bool operator> (const std::nullptr_t) const volatile noexcept { return word > 0; }
     //bitfield to 0/NULL/nullptr bitwise operators
-    checked_bit_field  operator& (const std::nullptr_t) const noexcept { return checked_bit_field(static_cast<word_t>(0)); }
-    checked_bit_field  operator| (const std::nullptr_t) const noexcept { return checked_bit_field(word); }
-    checked_bit_field  operator^ (const std::nullptr_t) const noexcept { return checked_bit_field(word); }
+    constexpr checked_bit_field  operator& (const std::nullptr_t) const noexcept { return checked_bit_field(static_cast<word_t>(0)); }
+    constexpr checked_bit_field  operator| (const std::nullptr_t) const noexcept { return checked_bit_field(word); }
+    constexpr checked_bit_field  operator^ (const std::nullptr_t) const noexcept { return checked_bit_field(word); }
     checked_bit_field  operator& (const std::nullptr_t) const volatile noexcept { return checked_bit_field(static_cast<word_t>(0)); }
     checked_bit_field  operator| (const std::nullptr_t) const volatile noexcept { return checked_bit_field(word); }
     checked_bit_field  operator^ (const std::nullptr_t) const volatile noexcept { return checked_bit_field(word); }
-    checked_bit_field& operator&=(const std::nullptr_t) noexcept { word &= 0; return *this; }
-    checked_bit_field& operator|=(const std::nullptr_t) noexcept { word |= 0; return *this; }
-    checked_bit_field& operator^=(const std::nullptr_t) noexcept { word ^= 0; return *this; }
-    volatile checked_bit_field& operator&=(const std::nullptr_t) volatile noexcept { word &= 0; return *this; }
-    volatile checked_bit_field& operator|=(const std::nullptr_t) volatile noexcept { word |= 0; return *this; }
-    volatile checked_bit_field& operator^=(const std::nullptr_t) volatile noexcept { word ^= 0; return *this; }
+    constexpr checked_bit_field& operator&=(const std::nullptr_t) noexcept { BITFIELD_RECORD_CHANGE(checked_bit_field, word, 0); word &= 0; return *this; }
+    constexpr checked_bit_field& operator|=(const std::nullptr_t) noexcept { word |= 0; return *this; }
+    constexpr checked_bit_field& operator^=(const std::nullptr_t) noexcept { word ^= 0; return *this; }
+    void operator&=(const std::nullptr_t) volatile noexcept { BITFIELD_RECORD_CHANGE(checked_bit_field, word, 0); word = word & 0; }
+    void operator|=(const std::nullptr_t) volatile noexcept { word = word | 0; }
+    void operator^=(const std::nullptr_t) volatile noexcept { word = word ^ 0; }
     //bitfield to bitfield comparison operators
-    bool operator==(const checked_bit_field& rhs) const noexcept { return word == rhs.word; }
-    bool operator!=(const checked_bit_field& rhs) const noexcept { return word != rhs.word; }
-    bool operator<=(const checked_bit_field& rhs) const noexcept { return word <= rhs.word; }
-    bool operator>=(const checked_bit_field& rhs) const noexcept { return word >= rhs.word; }
-    bool operator< (const checked_bit_field& rhs) const noexcept { return word <  rhs.word; }
-    bool operator> (const checked_bit_field& rhs) const noexcept { return word >  rhs.word; }
+    constexpr bool operator==(const checked_bit_field& rhs) const noexcept { return word == rhs.word; }
+    constexpr bool operator!=(const checked_bit_field& rhs) const noexcept { return word != rhs.word; }
+    constexpr bool operator<=(const checked_bit_field& rhs) const noexcept { return word <= rhs.word; }
+    constexpr bool operator>=(const checked_bit_field& rhs) const noexcept { return word >= rhs.word; }
+    constexpr bool operator< (const checked_bit_field& rhs) const noexcept { return word <  rhs.word; }
+    constexpr bool operator> (const checked_bit_field& rhs) const noexcept { return word >  rhs.word; }
     bool operator==(const volatile checked_bit_field& rhs) const noexcept { return word == rhs.word; }
     bool operator!=(const volatile checked_bit_field& rhs) const noexcept { return word != rhs.word; }
     bool operator<=(const volatile checked_bit_field& rhs) const noexcept { return word <= rhs.word; }
@@ -138,75 +556,95 @@ public:
     bool operator< (const volatile checked_bit_field& rhs) const volatile noexcept { return word <  rhs.word; }
     bool operator> (const volatile checked_bit_field& rhs) const volatile noexcept { return word >  rhs.word; }
     //bitfield to bitfield bitwise operators
-    checked_bit_field  operator~ () const noexcept { return checked_bit_field(~word); }
+    constexpr checked_bit_field  operator~ () const noexcept { return checked_bit_field(~word); }
     checked_bit_field  operator~ () const volatile noexcept { return checked_bit_field(~word); }
-    checked_bit_field  operator& (const checked_bit_field& rhs) const noexcept { return checked_bit_field(word & rhs.word); }
-    checked_bit_field  operator& (const checked_bit_field& rhs) const volatile noexcept { return checked_bit_field(word & rhs.word); }
-    checked_bit_field  operator& (const volatile checked_bit_field& rhs) const noexcept { return checked_bit_field(word & rhs.word); }
-    checked_bit_field  operator& (const volatile checked_bit_field& rhs) const volatile noexcept { return checked_bit_field(word & rhs.word); }
+    constexpr checked_bit_field  operator& (const checked_bit_field& rhs) const noexcept { BITFIELD_RECORD(checked_bit_field, test, rhs.word); return checked_bit_field(word & rhs.word); }
+    checked_bit_field  operator& (const checked_bit_field& rhs) const volatile noexcept { BITFIELD_RECORD(checked_bit_field, test, rhs.word); return checked_bit_field(word & rhs.word); }
+    checked_bit_field  operator& (const volatile checked_bit_field& rhs) const noexcept { BITFIELD_RECORD(checked_bit_field, test, rhs.word); return checked_bit_field(word & rhs.word); }
+    checked_bit_field  operator& (const volatile checked_bit_field& rhs) const volatile noexcept { BITFIELD_RECORD(checked_bit_field, test, rhs.word); return checked_bit_field(word & rhs.word); }
 
-    checked_bit_field  operator| (const checked_bit_field& rhs) const noexcept { return checked_bit_field(word | rhs.word); }
+    constexpr checked_bit_field  operator| (const checked_bit_field& rhs) const noexcept { return checked_bit_field(word | rhs.word); }
     checked_bit_field  operator| (const checked_bit_field& rhs) const volatile noexcept { return checked_bit_field(word | rhs.word); }
     checked_bit_field  operator| (const volatile checked_bit_field& rhs) const noexcept { return checked_bit_field(word | rhs.word); }
     checked_bit_field  operator| (const volatile checked_bit_field& rhs) const volatile noexcept { return checked_bit_field(word | rhs.word); }
-    checked_bit_field  operator^ (const checked_bit_field& rhs) const noexcept { return checked_bit_field(word ^ rhs.word); }
+    constexpr checked_bit_field  operator^ (const checked_bit_field& rhs) const noexcept { return checked_bit_field(word ^ rhs.word); }
     checked_bit_field  operator^ (const checked_bit_field& rhs) const volatile noexcept { return checked_bit_field(word ^ rhs.word); }
     checked_bit_field  operator^ (const volatile checked_bit_field& rhs) const noexcept { return checked_bit_field(word ^ rhs.word); }
     checked_bit_field  operator^ (const volatile checked_bit_field& rhs) const volatile noexcept { return checked_bit_field(word ^ rhs.word); }
-    checked_bit_field& operator&=(const checked_bit_field& rhs) noexcept { word &= rhs.word; return *this; }
-    checked_bit_field& operator|=(const checked_bit_field& rhs) noexcept { word |= rhs.word; return *this; }
-    checked_bit_field& operator^=(const checked_bit_field& rhs) noexcept { word ^= rhs.word; return *this; }
-    volatile checked_bit_field& operator&=(const checked_bit_field& rhs) volatile noexcept { word &= rhs.word; return *this; }
-    volatile checked_bit_field& operator|=(const checked_bit_field& rhs) volatile noexcept { word |= rhs.word; return *this; }
-    volatile checked_bit_field& operator^=(const checked_bit_field& rhs) volatile noexcept { word ^= rhs.word; return *this; }
-    volatile checked_bit_field& operator&=(const volatile checked_bit_field& rhs) volatile noexcept { word &= rhs.word; return *this; }
-    volatile checked_bit_field& operator|=(const volatile checked_bit_field& rhs) volatile noexcept { word |= rhs.word; return *this; }
-    volatile checked_bit_field& operator^=(const volatile checked_bit_field& rhs) volatile noexcept { word ^= rhs.word; return *this; }
+    constexpr checked_bit_field& operator&=(const checked_bit_field& rhs) noexcept { BITFIELD_RECORD_CHANGE(checked_bit_field, word, word & rhs.word); word &= rhs.word; return *this; }
+    constexpr checked_bit_field& operator|=(const checked_bit_field& rhs) noexcept { BITFIELD_RECORD_CHANGE(checked_bit_field, word, word | rhs.word); word |= rhs.word; return *this; }
+    constexpr checked_bit_field& operator^=(const checked_bit_field& rhs) noexcept { BITFIELD_RECORD_CHANGE(checked_bit_field, word, word ^ rhs.word); word ^= rhs.word; return *this; }
+    void operator&=(const checked_bit_field& rhs) volatile noexcept { BITFIELD_RECORD_CHANGE(checked_bit_field, word, word & rhs.word); word = word & rhs.word; }
+    void operator|=(const checked_bit_field& rhs) volatile noexcept { BITFIELD_RECORD_CHANGE(checked_bit_field, word, word | rhs.word); word = word | rhs.word; }
+    void operator^=(const checked_bit_field& rhs) volatile noexcept { BITFIELD_RECORD_CHANGE(checked_bit_field, word, word ^ rhs.word); word = word ^ rhs.word; }
+    void operator&=(const volatile checked_bit_field& rhs) volatile noexcept { BITFIELD_RECORD_CHANGE(checked_bit_field, word, word & rhs.word); word = word & rhs.word; }
+    void operator|=(const volatile checked_bit_field& rhs) volatile noexcept { BITFIELD_RECORD_CHANGE(checked_bit_field, word, word | rhs.word); word = word | rhs.word; }
+    void operator^=(const volatile checked_bit_field& rhs) volatile noexcept { BITFIELD_RECORD_CHANGE(checked_bit_field, word, word ^ rhs.word); word = word ^ rhs.word; }
     //bitfield to bitmask comparison operators
-    bool operator==(const fieldbit_t& rhs) const noexcept { return word == rhs.word; }
+    constexpr bool operator==(const fieldbit_t& rhs) const noexcept { return word == rhs.word; }
     bool operator==(const fieldbit_t& rhs) const volatile noexcept { return word == rhs.word; }
-    bool operator!=(const fieldbit_t& rhs) const noexcept { return word != rhs.word; }
+    constexpr bool operator!=(const fieldbit_t& rhs) const noexcept { return word != rhs.word; }
     bool operator!=(const fieldbit_t& rhs) const volatile noexcept { return word != rhs.word; }
-    bool operator<=(const fieldbit_t& rhs) const noexcept { return word <= rhs.word; }
+    constexpr bool operator<=(const fieldbit_t& rhs) const noexcept { return word <= rhs.word; }
     bool operator<=(const fieldbit_t& rhs) const volatile noexcept { return word <= rhs.word; }
-    bool operator>=(const fieldbit_t& rhs) const noexcept { return word >= rhs.word; }
+    constexpr bool operator>=(const fieldbit_t& rhs) const noexcept { return word >= rhs.word; }
     bool operator>=(const fieldbit_t& rhs) const volatile noexcept { return word >= rhs.word; }
-    bool operator< (const fieldbit_t& rhs) const noexcept { return word < rhs.word; }
+    constexpr bool operator< (const fieldbit_t& rhs) const noexcept { return word < rhs.word; }
     bool operator< (const fieldbit_t& rhs) const volatile noexcept { return word < rhs.word; }
-    bool operator> (const fieldbit_t& rhs) const noexcept { return word > rhs.word; }
+    constexpr bool operator> (const fieldbit_t& rhs) const noexcept { return word > rhs.word; }
     bool operator> (const fieldbit_t& rhs) const volatile noexcept { return word > rhs.word; }
     //bitfield to bitmask bitwise operators
-    checked_bit_field& operator&=(const fieldbit_t& rhs) noexcept { word &= rhs.word; return *this; }
-    checked_bit_field& operator|=(const fieldbit_t& rhs) noexcept { word |= rhs.word; return *this; }
-    checked_bit_field& operator^=(const fieldbit_t& rhs) noexcept { word ^= rhs.word; return *this; }
-    checked_bit_field  operator& (const fieldbit_t& rhs) const noexcept { return checked_bit_field(word & rhs.word); }
-    checked_bit_field  operator& (const fieldbit_t& rhs) const volatile noexcept { return checked_bit_field(word & rhs.word); }
-    checked_bit_field  operator| (const fieldbit_t& rhs) const noexcept { return checked_bit_field(word | rhs.word); }
+    constexpr checked_bit_field& operator&=(const fieldbit_t& rhs) noexcept { BITFIELD_RECORD_CHANGE(checked_bit_field, word, word & rhs.word); word &= rhs.word; return *this; }
+    constexpr checked_bit_field& operator|=(const fieldbit_t& rhs) noexcept { BITFIELD_RECORD_CHANGE(checked_bit_field, word, word | rhs.word); word |= rhs.word; return *this; }
+    constexpr checked_bit_field& operator^=(const fieldbit_t& rhs) noexcept { BITFIELD_RECORD_CHANGE(checked_bit_field, word, word ^ rhs.word); word ^= rhs.word; return *this; }
+    constexpr checked_bit_field  operator& (const fieldbit_t& rhs) const noexcept { BITFIELD_RECORD(checked_bit_field, test, rhs.word); return checked_bit_field(word & rhs.word); }
+    checked_bit_field  operator& (const fieldbit_t& rhs) const volatile noexcept { BITFIELD_RECORD(checked_bit_field, test, rhs.word); return checked_bit_field(word & rhs.word); }
+    constexpr checked_bit_field  operator| (const fieldbit_t& rhs) const noexcept { return checked_bit_field(word | rhs.word); }
     checked_bit_field  operator| (const fieldbit_t& rhs) const volatile noexcept { return checked_bit_field(word | rhs.word); }
-    checked_bit_field  operator^ (const fieldbit_t& rhs) const noexcept { return checked_bit_field(word ^ rhs.word); }
+    constexpr checked_bit_field  operator^ (const fieldbit_t& rhs) const noexcept { return checked_bit_field(word ^ rhs.word); }
     checked_bit_field  operator^ (const fieldbit_t& rhs) const volatile noexcept { return checked_bit_field(word ^ rhs.word); }
 
     //shift operators for all integer types
-    checked_bit_field  operator<< (const unsigned int s) const noexcept { assert(s <= 8 * sizeof(word_t)); return checked_bit_field(word << s); }
+    constexpr checked_bit_field  operator<< (const unsigned int s) const noexcept { assert(s <= 8 * sizeof(word_t)); return checked_bit_field(word << s); }
     checked_bit_field  operator<< (const unsigned int s) const volatile noexcept { assert(s <= 8 * sizeof(word_t)); return checked_bit_field(word << s); }
-    checked_bit_field  operator>> (const unsigned int s) const noexcept { assert(s <= 8 * sizeof(word_t)); return checked_bit_field(word >> s); }
+    constexpr checked_bit_field  operator>> (const unsigned int s) const noexcept { assert(s <= 8 * sizeof(word_t)); return checked_bit_field(word >> s); }
     checked_bit_field  operator>> (const unsigned int s) const volatile noexcept { assert(s <= 8 * sizeof(word_t)); return checked_bit_field(word >> s); }
-    checked_bit_field& operator<<=(const unsigned int s) noexcept { assert(s <= 8 * sizeof(word_t)); word <<= s; return *this; }
-    checked_bit_field& operator>>=(const unsigned int s) noexcept { assert(s <= 8 * sizeof(word_t)); word >>= s; return *this; }
-    volatile checked_bit_field& operator<<=(const unsigned int s) volatile noexcept { assert(s <= 8 * sizeof(word_t)); word <<= s; return *this; }
-    volatile checked_bit_field& operator>>=(const unsigned int s) volatile noexcept { assert(s <= 8 * sizeof(word_t)); word >>= s; return *this; }
+    constexpr checked_bit_field& operator<<=(const unsigned int s) noexcept { assert(s <= 8 * sizeof(word_t)); BITFIELD_RECORD_CHANGE(checked_bit_field, word, word << s); word <<= s; return *this; }
+    constexpr checked_bit_field& operator>>=(const unsigned int s) noexcept { assert(s <= 8 * sizeof(word_t)); BITFIELD_RECORD_CHANGE(checked_bit_field, word, word >> s); word >>= s; return *this; }
+    void operator<<=(const unsigned int s) volatile noexcept { assert(s <= 8 * sizeof(word_t)); BITFIELD_RECORD_CHANGE(checked_bit_field, word, word << s); word = word << s; }
+    void operator>>=(const unsigned int s) volatile noexcept { assert(s <= 8 * sizeof(word_t)); BITFIELD_RECORD_CHANGE(checked_bit_field, word, word >> s); word = word >> s; }
+
+    //bit queries
+    //number of set bits
+    constexpr unsigned int count() const noexcept { return bitfield_detail::popcount(word); }
+    unsigned int count() const volatile noexcept { return bitfield_detail::popcount(word); }
+    //any/all/none of the bits of mask are set
+    constexpr bool any(const checked_bit_field& mask) const noexcept { BITFIELD_RECORD(checked_bit_field, test, mask.word); return (word & mask.word) != 0; }
+    bool any(const checked_bit_field& mask) const volatile noexcept { BITFIELD_RECORD(checked_bit_field, test, mask.word); return (word & mask.word) != 0; }
+    constexpr bool all(const checked_bit_field& mask) const noexcept { BITFIELD_RECORD(checked_bit_field, test, mask.word); return (word & mask.word) == mask.word; }
+    bool all(const checked_bit_field& mask) const volatile noexcept { BITFIELD_RECORD(checked_bit_field, test, mask.word); return (word & mask.word) == mask.word; }
+    constexpr bool none(const checked_bit_field& mask) const noexcept { BITFIELD_RECORD(checked_bit_field, test, mask.word); return (word & mask.word) == 0; }
+    bool none(const checked_bit_field& mask) const volatile noexcept { BITFIELD_RECORD(checked_bit_field, test, mask.word); return (word & mask.word) == 0; }
+    //position of the lowest/highest set bit, numbered from 1 as in set_bit. 0 if no bit is set.
+    constexpr unsigned int first_set() const noexcept { return bitfield_detail::first_set(word); }
+    unsigned int first_set() const volatile noexcept { return bitfield_detail::first_set(word); }
+    constexpr unsigned int last_set() const noexcept { return bitfield_detail::last_set(word); }
+    unsigned int last_set() const volatile noexcept { return bitfield_detail::last_set(word); }
+    //range over the set bits - for (fieldbit_t bit : field.each_set_bit())
+    constexpr bitfield_bit_range<checked_bit_field> each_set_bit() const noexcept { return bitfield_bit_range<checked_bit_field>(static_cast<typename std::make_unsigned<word_t>::type>(word)); }
+    bitfield_bit_range<checked_bit_field> each_set_bit() const volatile noexcept { return bitfield_bit_range<checked_bit_field>(static_cast<typename std::make_unsigned<word_t>::type>(word)); }
 
     //logical operators
-    const bool operator!() const noexcept { return (word == 0 ? true : false); }
-    const bool operator!() const volatile noexcept { return (word == 0 ? true : false); }
+    constexpr bool operator!() const noexcept { return (word == 0 ? true : false); }
+    bool operator!() const volatile noexcept { return (word == 0 ? true : false); }
 
     //conversion to bool
     /*need explicit as bool can convert to integer (i.e. 0 or 1), that means we can do
     something like checked_bit_field + int unless explicit is declared. Note, explicit means we
     can't do bool truefalse = checked_bit_field. That requires we drop explicit. To get around
     you must do bool truefalse = (bool)checked_bit_field.*/
-    explicit operator const bool() const noexcept { return (word != 0 ? true : false); }
-    explicit operator const bool () const volatile noexcept { return (word != 0 ? true : false); }
+    constexpr explicit operator bool() const noexcept { return (word != 0 ? true : false); }
+    explicit operator bool() const volatile noexcept { return (word != 0 ? true : false); }
 
     //deleted operators
     checked_bit_field operator-()  = delete;
@@ -231,14 +669,7 @@ public:
     template<class T> checked_bit_field operator/=(T) const volatile = delete;
     template<class T> checked_bit_field operator%=(T) const volatile = delete;
 
-#ifdef _MSC_VER
-//multiple copy constructors specified
-//multiple assignment operators specified
-#pragma warning(suppress : 4521 4522)
 };
-#elif
-};
-#endif
 
 
 template <bitfield_unique_id* unique_id, typename word_t>
@@ -248,7 +679,7 @@ private:
     word_t word;
 
     // private constructor from an integer type.
-    explicit checked_bit_mask(word_t init) noexcept : word(init) {}
+    constexpr explicit checked_bit_mask(word_t init) noexcept : word(init) {}
 
 public:
     //static factory constructor
@@ -270,29 +701,30 @@ public:
 
     // Corresponding bit field type.
     friend class checked_bit_field<unique_id, word_t>;
+    friend struct bitfield_traits<checked_bit_field<unique_id, word_t>>;
     typedef checked_bit_field<unique_id, word_t> field_t;
 
     //--Constructors--
     //default constructor - our "word" is zeroed
-    explicit checked_bit_mask() noexcept : word(0) {}
+    constexpr explicit checked_bit_mask() noexcept : word(0) {}
     //copy constructor
-    checked_bit_mask(const checked_bit_mask& rhs) noexcept : word(rhs.word) {}
-    checked_bit_mask(const std::nullptr_t) noexcept : word(static_cast<word_t>(0)) {}
+    constexpr checked_bit_mask(const checked_bit_mask&) noexcept = default;
+    constexpr checked_bit_mask(const std::nullptr_t) noexcept : word(static_cast<word_t>(0)) {}
 
     //--Operations--
 
     //bitmask to bitfield comparison operators
-    bool operator==(const field_t& rhs) const noexcept { return word == rhs.word; }
+    constexpr bool operator==(const field_t& rhs) const noexcept { return word == rhs.word; }
     bool operator==(const volatile field_t& rhs) const noexcept { return word == rhs.word; }
-    bool operator!=(const field_t& rhs) const noexcept { return word != rhs.word; }
+    constexpr bool operator!=(const field_t& rhs) const noexcept { return word != rhs.word; }
     bool operator!=(const volatile field_t& rhs) const noexcept { return word != rhs.word; }
-    bool operator<=(const field_t& rhs) const noexcept { return word <= rhs.word; }
+    constexpr bool operator<=(const field_t& rhs) const noexcept { return word <= rhs.word; }
     bool operator<=(const volatile field_t& rhs) const noexcept { return word <= rhs.word; }
-    bool operator>=(const field_t& rhs) const { return word >= rhs.word; }
+    constexpr bool operator>=(const field_t& rhs) const noexcept { return word >= rhs.word; }
     bool operator>=(const volatile field_t& rhs) const noexcept { return word >= rhs.word; }
-    bool operator< (const field_t& rhs) const { return word < rhs.word; }
+    constexpr bool operator< (const field_t& rhs) const noexcept { return word < rhs.word; }
     bool operator< (const volatile field_t& rhs) const noexcept { return word < rhs.word; }
-    bool operator> (const field_t& rhs) const { return word > rhs.word; }
+    constexpr bool operator> (const field_t& rhs) const noexcept { return word > rhs.word; }
     bool operator> (const volatile field_t& rhs) const noexcept { return word > rhs.word; }
 
     //bitmask to bitmask bitwise operators
@@ -302,31 +734,1127 @@ public:
     constexpr checked_bit_mask operator^(const checked_bit_mask& rhs) const noexcept { return checked_bit_mask(word ^ rhs.word); }
 
     //bitmask to bitfield bitwise operators
-    field_t operator|(const field_t& rhs) const noexcept { return field_t(word | rhs.word); }
+    constexpr field_t operator|(const field_t& rhs) const noexcept { return field_t(word | rhs.word); }
     field_t operator|(const volatile field_t& rhs) const noexcept { return field_t(word | rhs.word); }
-    field_t operator&(const field_t& rhs) const noexcept { return field_t(word & rhs.word); }
-    field_t operator&(const volatile field_t& rhs) const noexcept { return field_t(word & rhs.word); }
-    field_t operator^(const field_t& rhs) const noexcept { return field_t(word ^ rhs.word); }
+    constexpr field_t operator&(const field_t& rhs) const noexcept { BITFIELD_RECORD(field_t, test, word); return field_t(word & rhs.word); }
+    field_t operator&(const volatile field_t& rhs) const noexcept { BITFIELD_RECORD(field_t, test, word); return field_t(word & rhs.word); }
+    constexpr field_t operator^(const field_t& rhs) const noexcept { return field_t(word ^ rhs.word); }
     field_t operator^(const volatile field_t& rhs) const noexcept { return field_t(word ^ rhs.word); }
 };
 
+//bitfield_traits for the checked types, see the primary template above
+template <bitfield_unique_id* id, typename word_type>
+struct bitfield_traits<checked_bit_field<id, word_type>>
+{
+    typedef word_type word_t;
+    typedef checked_bit_field<id, word_type> field_t;
+    typedef checked_bit_mask<id, word_type> fieldbit_t;
+    static constexpr bitfield_unique_id* unique_id = id;
+
+    static constexpr word_t to_word(const field_t& f) noexcept { return f.word; }
+    static constexpr word_t to_word(const fieldbit_t& m) noexcept { return m.word; }
+    static constexpr field_t to_field(const word_t w) noexcept { return field_t(w); }
+    static constexpr fieldbit_t to_fieldbit(const word_t w) noexcept { return fieldbit_t(w); }
+    //a checked_bit_field is laid out exactly as its word, so an array of fields is an array of words
+    static_assert(sizeof(field_t) == sizeof(word_t) && std::is_standard_layout<field_t>::value, "checked_bit_field must have the layout of its word");
+    //and copies as one, the checked build costs nothing over the plain integer
+    static_assert(std::is_trivially_copyable<field_t>::value && std::is_trivially_copyable<fieldbit_t>::value, "checked_bit_field must copy as its word");
+    static const word_t* to_words(const field_t* f) noexcept { return reinterpret_cast<const word_t*>(f); }
+    static word_t* to_words(field_t* f) noexcept { return reinterpret_cast<word_t*>(f); }
+    static const field_t* to_fields(const word_t* w) noexcept { return reinterpret_cast<const field_t*>(w); }
+    static field_t* to_fields(word_t* w) noexcept { return reinterpret_cast<field_t*>(w); }
+};
+
 // All macros are conditionally defined to use the checked_bit_field classes if _DEBUG is defined.
 //bit field type declaration - BIT_FIELD(long, mybitfield);
 #define BIT_FIELD( word_t,  bitfield_t ) extern bitfield_unique_id ui_##bitfield_t; typedef checked_bit_field<&ui_##bitfield_t, word_t> bitfield_t
 //bit mask declaration - BIT_MASK(mybitfield, mask1, 0); BIT_MASK(mybitfield, mask2, 1);
-#define BIT_MASK( bitfield_t, label, bit_pos ) const bitfield_t::fieldbit_t label = bitfield_t::fieldbit_t::set_bit<bit_pos>()
+#ifdef _BITFIELD_INSTRUMENT
+//also names the bit in bitfield_instrument dumps
+#define BIT_MASK( bitfield_t, label, bit_pos ) struct label##_bitfield_label { static const char* name() noexcept { return #label; } }; \
+    static constexpr bitfield_t::fieldbit_t label = bitfield_instrument_label<bitfield_t, bit_pos, label##_bitfield_label>::mask()
+#else
+#define BIT_MASK( bitfield_t, label, bit_pos ) static constexpr bitfield_t::fieldbit_t label = bitfield_t::fieldbit_t::set_bit<bit_pos>()
+#endif
 //bit mask declaration with integer - INT_BIT_MASK(mybitfield, mask1and2, 3)
-#define INT_BIT_MASK( bitfield_t, label, int_mask) const bitfield_t::fieldbit_t label = bitfield_t::fieldbit_t::set_bits<int_mask>()
+#define INT_BIT_MASK( bitfield_t, label, int_mask) static constexpr bitfield_t::fieldbit_t label = bitfield_t::fieldbit_t::set_bits<int_mask>()
 //complex bit constant declaration - BIT_MASKS(mybitfield, complexbitmask) = mask1 | mask2;
 #define BIT_MASKS( bitfield_t, label ) const bitfield_t::fieldbit_t label
 #else
 //bit field type declaration - BIT_FIELD(long, mybitfield);
 #define BIT_FIELD(word_t, bitfield_t ) typedef word_t bitfield_t
 //bit mask declaration - BIT_MASK(mybitfield, mask1, 0); BIT_MASK(mybitfield, mask2, 1);
-inline constexpr unsigned int returnbit(unsigned int i) { return (i > 0) ? (1u << (i - 1)) : 0; };
+inline constexpr unsigned long long returnbit(unsigned int i) { return (i > 0) ? (1ull << (i - 1)) : 0; };
 #define BIT_MASK( bitfield_t, label, bit_pos ) static constexpr bitfield_t label = returnbit(bit_pos)
 //bit mask declaration with integer - INT_BIT_MASK(mybitfield, mask1and2, 3)
 #define INT_BIT_MASK( bitfield_t, label, int_mask) static constexpr bitfield_t label = int_mask
 //complex bit constant declaration - BIT_MASKS(mybitfield, complexbitmask) = mask1 | mask2;
 #define BIT_MASKS( field_t, label ) static const field_t label
 #endif // SAFE_BIT_FIELD
+
+//--Bit queries--
+//free function forms of the checked_bit_field queries, these behave the same in the checked and the plain
+//integer build. Masks are converted to the field type, so any fieldbit_t of the field can be passed.
+template <typename field_type>
+constexpr unsigned int bitfield_count(const field_type& field) noexcept { return bitfield_detail::popcount(bitfield_traits<field_type>::to_word(field)); }
+template <typename field_type>
+constexpr bool bitfield_any(const field_type& field) noexcept { return bitfield_traits<field_type>::to_word(field) != 0; }
+template <typename field_type, typename mask_type>
+bool bitfield_any(const field_type& field, const mask_type& mask) noexcept
+{
+    typedef bitfield_traits<field_type> traits;
+    return (traits::to_word(field) & traits::to_word(typename traits::field_t(mask))) != 0;
+}
+template <typename field_type, typename mask_type>
+bool bitfield_all(const field_type& field, const mask_type& mask) noexcept
+{
+    typedef bitfield_traits<field_type> traits;
+    const typename traits::word_t m = traits::to_word(typename traits::field_t(mask));
+    return (traits::to_word(field) & m) == m;
+}
+template <typename field_type>
+constexpr bool bitfield_none(const field_type& field) noexcept { return bitfield_traits<field_type>::to_word(field) == 0; }
+template <typename field_type, typename mask_type>
+bool bitfield_none(const field_type& field, const mask_type& mask) noexcept { return !bitfield_any(field, mask); }
+//position of the lowest/highest set bit, numbered from 1 as in BIT_MASK. 0 if no bit is set.
+template <typename field_type>
+constexpr unsigned int bitfield_first_set(const field_type& field) noexcept { return bitfield_detail::first_set(bitfield_traits<field_type>::to_word(field)); }
+template <typename field_type>
+constexpr unsigned int bitfield_last_set(const field_type& field) noexcept { return bitfield_detail::last_set(bitfield_traits<field_type>::to_word(field)); }
+//range over the set bits - for (auto bit : bitfield_each_set_bit(field))
+template <typename field_type>
+constexpr bitfield_bit_range<field_type> bitfield_each_set_bit(const field_type& field) noexcept
+{
+    return bitfield_bit_range<field_type>(static_cast<typename bitfield_bit_range<field_type>::iterator::uword_t>(bitfield_traits<field_type>::to_word(field)));
+}
+
+//--Subfields--
+//checked_bit_subfield stores a small value (a 3 bit priority, a 4 bit state enum) in "width" bits of a BIT_FIELD
+//word starting at bit "offset", numbered from 1 as in BIT_MASK. Masks and shifts are compile time constants.
+//Declare through BIT_SUBFIELD - BIT_SUBFIELD(mybitfield, priority, 2, 3, unsigned int); then
+//priority.get(field), priority.set(field, 5) and bitfield_set(field, priority(5), state(state_t::idle)).
+template <typename field_type, unsigned int offset, unsigned int width, typename value_type>
+struct checked_bit_subfield
+{
+    typedef bitfield_traits<field_type> traits;
+    typedef typename traits::word_t word_t;
+    typedef typename traits::field_t field_t;
+    typedef typename traits::fieldbit_t fieldbit_t;
+    typedef typename std::make_unsigned<word_t>::type uword_t;
+    typedef value_type value_t;
+
+    static_assert(offset >= 1 && width >= 1 && offset - 1 + width <= 8 * sizeof(word_t), "subfield must be within bounds of field");
+    static_assert(std::is_enum<value_type>::value || std::is_same<value_type, bool>::value || std::is_unsigned<value_type>::value, "subfield values must be unsigned, bool or an enum");
+
+    static constexpr unsigned int shift = offset - 1;
+    static constexpr unsigned int bits = width;
+    //mask of the value before shifting and of the subfield within the word
+    static constexpr uword_t value_mask = width == 8 * sizeof(word_t) ? static_cast<uword_t>(~uword_t(0)) : static_cast<uword_t>((uword_t(1) << (width % (8 * sizeof(word_t)))) - 1);
+    static constexpr uword_t word_mask = static_cast<uword_t>(value_mask << shift);
+
+    //the bits of the subfield as a mask of the field
+    static fieldbit_t mask() noexcept { return traits::to_fieldbit(static_cast<word_t>(word_mask)); }
+
+    static uword_t extract(const uword_t w) noexcept
+    {
+    #ifdef BITFIELD_BMI
+        if (sizeof(uword_t) == 8) return static_cast<uword_t>(_bextr_u64(static_cast<unsigned long long>(w), shift, width));
+        if (sizeof(uword_t) == 4) return static_cast<uword_t>(_bextr_u32(static_cast<unsigned int>(w), shift, width));
+    #endif
+        return static_cast<uword_t>((w >> shift) & value_mask);
+    }
+    static uword_t place(const value_type v) noexcept
+    {
+        assert((static_cast<uword_t>(v) & ~value_mask) == 0 && "value doesn't fit in the subfield");
+        return static_cast<uword_t>((static_cast<uword_t>(v) & value_mask) << shift);
+    }
+
+    static value_type get(const field_t& field) noexcept { return static_cast<value_type>(extract(static_cast<uword_t>(traits::to_word(field)))); }
+    static void set(field_t& field, const value_type v) noexcept { field = with(field, v); }
+    //field with the subfield replaced by v
+    static field_t with(const field_t& field, const value_type v) noexcept
+    {
+        return traits::to_field(static_cast<word_t>((static_cast<uword_t>(traits::to_word(field)) & ~word_mask) | place(v)));
+    }
+
+    //a value bound to this subfield, for bitfield_set
+    struct bound_value
+    {
+        typedef checked_bit_subfield subfield_t;
+        value_type value;
+    };
+    constexpr bound_value operator()(const value_type v) const noexcept { return bound_value{ v }; }
+};
+
+namespace bitfield_detail
+{
+    //number of bits of the subfields below subfield_t, its position once the subfields are packed together
+    template <typename subfield_t, typename... subfields>
+    constexpr unsigned int packed_shift() noexcept
+    {
+        unsigned int s = 0;
+        const unsigned int shifts[] = { subfields::shift... };
+        const unsigned int widths[] = { subfields::bits... };
+        for (std::size_t i = 0; i < sizeof...(subfields); ++i)
+            if (shifts[i] < subfield_t::shift) s += widths[i];
+        return s;
+    }
+    template <typename uword_t, typename... subfields>
+    constexpr bool disjoint() noexcept
+    {
+        const uword_t masks[] = { static_cast<uword_t>(subfields::word_mask)... };
+        uword_t seen = 0;
+        for (const uword_t m : masks)
+        {
+            if ((seen & m) != 0) return false;
+            seen |= m;
+        }
+        return true;
+    }
+}
+
+//reads several subfields of a field with one load - auto [prio, state] = bitfield_get(field, priority, state);
+template <typename field_type, typename... subfields>
+std::tuple<typename subfields::value_t...> bitfield_get(const field_type& field, const subfields&...) noexcept
+{
+    typedef bitfield_traits<field_type> traits;
+    const typename std::make_unsigned<typename traits::word_t>::type w = traits::to_word(field);
+    return std::tuple<typename subfields::value_t...>(static_cast<typename subfields::value_t>(subfields::extract(w))...);
+}
+//writes several subfields of a field in one read-modify-write - bitfield_set(field, priority(5), state(state_t::idle));
+template <typename field_type, typename... bound_values>
+void bitfield_set(field_type& field, const bound_values&... values) noexcept
+{
+    typedef bitfield_traits<field_type> traits;
+    typedef typename std::make_unsigned<typename traits::word_t>::type uword_t;
+    static_assert(bitfield_detail::disjoint<uword_t, typename bound_values::subfield_t...>(), "subfields must not overlap");
+    const uword_t clear = static_cast<uword_t>((uword_t(0) | ... | bound_values::subfield_t::word_mask));
+    const uword_t set = static_cast<uword_t>((uword_t(0) | ... | bound_values::subfield_t::place(values.value)));
+    field = traits::to_field(static_cast<typename traits::word_t>((static_cast<uword_t>(traits::to_word(field)) & ~clear) | set));
+}
+//the subfields packed next to each other, lowest subfield in the lowest bits. A single PEXT with BMI2.
+template <typename field_type, typename... subfields>
+typename std::make_unsigned<typename bitfield_traits<field_type>::word_t>::type bitfield_extract_packed(const field_type& field, const subfields&...) noexcept
+{
+    typedef bitfield_traits<field_type> traits;
+    typedef typename std::make_unsigned<typename traits::word_t>::type uword_t;
+    static_assert(bitfield_detail::disjoint<uword_t, subfields...>(), "subfields must not overlap");
+    const uword_t w = static_cast<uword_t>(traits::to_word(field));
+#ifdef BITFIELD_BMI2
+    constexpr uword_t mask = static_cast<uword_t>((uword_t(0) | ... | subfields::word_mask));
+    if (sizeof(uword_t) == 8) return static_cast<uword_t>(_pext_u64(static_cast<unsigned long long>(w), mask));
+    if (sizeof(uword_t) == 4) return static_cast<uword_t>(_pext_u32(static_cast<unsigned int>(w), static_cast<unsigned int>(mask)));
+#endif
+    return static_cast<uword_t>((uword_t(0) | ... | static_cast<uword_t>(subfields::extract(w) << bitfield_detail::packed_shift<subfields, subfields...>())));
+}
+//inverse of bitfield_extract_packed, replaces the subfields with the packed bits. A single PDEP with BMI2.
+template <typename field_type, typename... subfields>
+void bitfield_deposit_packed(field_type& field, const typename std::make_unsigned<typename bitfield_traits<field_type>::word_t>::type packed, const subfields&...) noexcept
+{
+    typedef bitfield_traits<field_type> traits;
+    typedef typename std::make_unsigned<typename traits::word_t>::type uword_t;
+    static_assert(bitfield_detail::disjoint<uword_t, subfields...>(), "subfields must not overlap");
+    constexpr uword_t mask = static_cast<uword_t>((uword_t(0) | ... | subfields::word_mask));
+    uword_t bits = 0;
+#ifdef BITFIELD_BMI2
+    if (sizeof(uword_t) == 8) bits = static_cast<uword_t>(_pdep_u64(static_cast<unsigned long long>(packed), mask));
+    else if (sizeof(uword_t) == 4) bits = static_cast<uword_t>(_pdep_u32(static_cast<unsigned int>(packed), static_cast<unsigned int>(mask)));
+    else
+#endif
+    bits = static_cast<uword_t>((uword_t(0) | ... | static_cast<uword_t>(((packed >> bitfield_detail::packed_shift<subfields, subfields...>()) & subfields::value_mask) << subfields::shift)));
+    field = traits::to_field(static_cast<typename traits::word_t>((static_cast<uword_t>(traits::to_word(field)) & ~mask) | bits));
+}
+
+//subfield declaration - BIT_SUBFIELD(mybitfield, priority, 2, 3, unsigned int); holds bits 2 to 4
+#define BIT_SUBFIELD( bitfield_t, label, offset, width, value_type ) static constexpr checked_bit_subfield<bitfield_t, offset, width, value_type> label{}
+
+//--Atomic bit fields--
+//checked_atomic_bit_field shares a BIT_FIELD type between threads. Every read-modify-write is a single atomic
+//operation on a std::atomic word and takes an explicit memory order. It works with both the checked and the
+//plain integer build, so declare it through ATOMIC_BIT_FIELD.
+template <typename field_type>
+class checked_atomic_bit_field
+{
+public:
+    typedef bitfield_traits<field_type> traits;
+    typedef typename traits::word_t word_t;
+    typedef typename traits::field_t field_t;
+    typedef typename traits::fieldbit_t fieldbit_t;
+
+private:
+    //the actual field
+    std::atomic<word_t> word;
+
+public:
+    //--Constructors--
+    //default constructor - our "word" is zeroed
+    checked_atomic_bit_field() noexcept : word(static_cast<word_t>(0)) {}
+    //constructor from bitfield, masks convert to the bitfield
+    checked_atomic_bit_field(const field_t& init) noexcept : word(traits::to_word(init)) {}
+    //atomics can't be copied
+    checked_atomic_bit_field(const checked_atomic_bit_field&) = delete;
+    checked_atomic_bit_field& operator=(const checked_atomic_bit_field&) = delete;
+
+    bool is_lock_free() const noexcept { return word.is_lock_free(); }
+
+    //--Loads and stores--
+    field_t load(const std::memory_order order = std::memory_order_seq_cst) const noexcept { return traits::to_field(word.load(order)); }
+    void store(const field_t& rhs, const std::memory_order order = std::memory_order_seq_cst) noexcept { word.store(traits::to_word(rhs), order); }
+    field_t exchange(const field_t& rhs, const std::memory_order order = std::memory_order_seq_cst) noexcept { return traits::to_field(word.exchange(traits::to_word(rhs), order)); }
+    bool compare_exchange_weak(field_t& expected, const field_t& desired, const std::memory_order success, const std::memory_order failure) noexcept
+    {
+        word_t w = traits::to_word(expected);
+        const bool exchanged = word.compare_exchange_weak(w, traits::to_word(desired), success, failure);
+        expected = traits::to_field(w);
+        return exchanged;
+    }
+    bool compare_exchange_strong(field_t& expected, const field_t& desired, const std::memory_order success, const std::memory_order failure) noexcept
+    {
+        word_t w = traits::to_word(expected);
+        const bool exchanged = word.compare_exchange_strong(w, traits::to_word(desired), success, failure);
+        expected = traits::to_field(w);
+        return exchanged;
+    }
+
+    //--Read-modify-write operations--
+    //each returns the field as it was before the operation
+    field_t fetch_or (const field_t& rhs, const std::memory_order order = std::memory_order_seq_cst) noexcept { return traits::to_field(word.fetch_or (traits::to_word(rhs), order)); }
+    field_t fetch_and(const field_t& rhs, const std::memory_order order = std::memory_order_seq_cst) noexcept { return traits::to_field(word.fetch_and(traits::to_word(rhs), order)); }
+    field_t fetch_xor(const field_t& rhs, const std::memory_order order = std::memory_order_seq_cst) noexcept { return traits::to_field(word.fetch_xor(traits::to_word(rhs), order)); }
+
+    //sets the bits of mask, returns true if any of them was already set
+    bool test_and_set(const field_t& mask, const std::memory_order order = std::memory_order_seq_cst) noexcept
+    {
+        return (word.fetch_or(traits::to_word(mask), order) & traits::to_word(mask)) != 0;
+    }
+    //clears the bits of mask, returns true if any of them was set
+    bool test_and_clear(const field_t& mask, const std::memory_order order = std::memory_order_seq_cst) noexcept
+    {
+        return (word.fetch_and(static_cast<word_t>(~traits::to_word(mask)), order) & traits::to_word(mask)) != 0;
+    }
+    //true if any bit of mask is set
+    bool test(const field_t& mask, const std::memory_order order = std::memory_order_seq_cst) const noexcept
+    {
+        return (word.load(order) & traits::to_word(mask)) != 0;
+    }
+
+    //blocks until any bit of mask is set and returns the field that was seen. Spins briefly, then yields the
+    //thread between loads, so writers don't need to notify waiters.
+    field_t wait_for_any(const field_t& mask, const std::memory_order order = std::memory_order_seq_cst) const noexcept
+    {
+        const word_t m = traits::to_word(mask);
+        word_t w = word.load(order);
+        for (unsigned int spins = 0; (w & m) == 0; w = word.load(order))
+        {
+            if (spins < 64)
+            {
+                ++spins;
+            #ifdef BITFIELD_SSE2
+                _mm_pause();
+            #endif
+            }
+            else
+                std::this_thread::yield();
+        }
+        return traits::to_field(w);
+    }
+
+    //replaces the field with fn(field) in a compare-exchange loop and returns the field fn was last given.
+    //fn may be called several times and should have no side effects.
+    template <typename fn_t>
+    field_t update(fn_t fn, const std::memory_order success, const std::memory_order failure) noexcept(noexcept(fn(std::declval<field_t>())))
+    {
+        word_t w = word.load(failure);
+        while (!word.compare_exchange_weak(w, traits::to_word(fn(traits::to_field(w))), success, failure)) {}
+        return traits::to_field(w);
+    }
+    template <typename fn_t>
+    field_t update(fn_t fn, const std::memory_order order = std::memory_order_seq_cst) noexcept(noexcept(fn(std::declval<field_t>())))
+    {
+        //the failure order of a compare-exchange can't be a release order
+        const std::memory_order failure = order == std::memory_order_acq_rel ? std::memory_order_acquire :
+            (order == std::memory_order_release ? std::memory_order_relaxed : order);
+        return update(fn, order, failure);
+    }
+};
+
+//atomic bit field type declaration - ATOMIC_BIT_FIELD(mybitfield, myatomicbitfield);
+#define ATOMIC_BIT_FIELD( bitfield_t, atomic_bitfield_t ) typedef checked_atomic_bit_field<bitfield_t> atomic_bitfield_t
+
+//--Wide bit fields--
+//checked_wide_bit_field holds "bits" flags in an array of words, for flag sets that don't fit in a single
+//integer. The bitwise operators run over the whole array with the widest vector unit enabled at compile time.
+namespace bitfield_detail
+{
+    //tag for the private constructors that leave the words to be written by a kernel
+    struct uninitialized_t {};
+
+    //alignment of the word array: the largest power of two dividing its size, capped at a cache line
+    template <typename word_t, std::size_t words>
+    constexpr std::size_t wide_alignment() noexcept
+    {
+        std::size_t bytes = words * sizeof(word_t);
+        std::size_t align = 64;
+        while (bytes % align != 0) align /= 2;
+        return align < alignof(word_t) ? alignof(word_t) : align;
+    }
+
+    //bitwise operation policies for wide_apply
+    struct op_and
+    {
+        template <typename word_t> static constexpr word_t scalar(word_t a, word_t b) noexcept { return a & b; }
+    #ifdef BITFIELD_SSE2
+        static __m128i v128(__m128i a, __m128i b) noexcept { return _mm_and_si128(a, b); }
+    #endif
+    #ifdef BITFIELD_AVX2
+        static __m256i v256(__m256i a, __m256i b) noexcept { return _mm256_and_si256(a, b); }
+    #endif
+    #ifdef BITFIELD_AVX512
+        static __m512i v512(__m512i a, __m512i b) noexcept { return _mm512_and_si512(a, b); }
+    #endif
+    };
+    struct op_or
+    {
+        template <typename word_t> static constexpr word_t scalar(word_t a, word_t b) noexcept { return a | b; }
+    #ifdef BITFIELD_SSE2
+        static __m128i v128(__m128i a, __m128i b) noexcept { return _mm_or_si128(a, b); }
+    #endif
+    #ifdef BITFIELD_AVX2
+        static __m256i v256(__m256i a, __m256i b) noexcept { return _mm256_or_si256(a, b); }
+    #endif
+    #ifdef BITFIELD_AVX512
+        static __m512i v512(__m512i a, __m512i b) noexcept { return _mm512_or_si512(a, b); }
+    #endif
+    };
+    struct op_xor
+    {
+        template <typename word_t> static constexpr word_t scalar(word_t a, word_t b) noexcept { return a ^ b; }
+    #ifdef BITFIELD_SSE2
+        static __m128i v128(__m128i a, __m128i b) noexcept { return _mm_xor_si128(a, b); }
+    #endif
+    #ifdef BITFIELD_AVX2
+        static __m256i v256(__m256i a, __m256i b) noexcept { return _mm256_xor_si256(a, b); }
+    #endif
+    #ifdef BITFIELD_AVX512
+        static __m512i v512(__m512i a, __m512i b) noexcept { return _mm512_xor_si512(a, b); }
+    #endif
+    };
+    //a & ~b
+    struct op_andnot
+    {
+        template <typename word_t> static constexpr word_t scalar(word_t a, word_t b) noexcept { return a & static_cast<word_t>(~b); }
+    #ifdef BITFIELD_SSE2
+        static __m128i v128(__m128i a, __m128i b) noexcept { return _mm_andnot_si128(b, a); }
+    #endif
+    #ifdef BITFIELD_AVX2
+        static __m256i v256(__m256i a, __m256i b) noexcept { return _mm256_andnot_si256(b, a); }
+    #endif
+    #ifdef BITFIELD_AVX512
+        //not _mm512_andnot_si512, which GCC 12 builds on an uninitialized vector and warns about, this is still vpandn
+        static __m512i v512(__m512i a, __m512i b) noexcept { return _mm512_and_si512(a, _mm512_xor_si512(b, _mm512_set1_epi32(-1))); }
+    #endif
+    };
+
+    //dst[i] = op(a[i], b[i]) for the n words. dst may alias a or b. Each vector loop runs to n - n % step, the
+    //steps divide each other so that is where the whole vectors of every width end.
+    template <typename op, typename word_t>
+    inline void wide_apply(word_t* dst, const word_t* a, const word_t* b, const std::size_t n) noexcept
+    {
+        std::size_t w = 0;
+    #ifdef BITFIELD_AVX512
+        for (const std::size_t step = 64 / sizeof(word_t), body = n - n % step; w < body; w += step)
+            _mm512_storeu_si512(dst + w, op::v512(_mm512_loadu_si512(a + w), _mm512_loadu_si512(b + w)));
+    #endif
+    #ifdef BITFIELD_AVX2
+        for (const std::size_t step = 32 / sizeof(word_t), body = n - n % step; w < body; w += step)
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + w), op::v256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + w)), _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + w))));
+    #endif
+    #ifdef BITFIELD_SSE2
+        for (const std::size_t step = 16 / sizeof(word_t), body = n - n % step; w < body; w += step)
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + w), op::v128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a + w)), _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + w))));
+    #endif
+        for (; w < n; ++w)
+            dst[w] = op::template scalar<word_t>(a[w], b[w]);
+    }
+
+    //true if op(a[i], b[i]) is zero for all n words, i.e. a == b for op_xor and (a & b) == 0 for op_and.
+    //Passing b == a with op_or tests a single array for zero.
+    template <typename op, typename word_t>
+    inline bool wide_none(const word_t* a, const word_t* b, const std::size_t n) noexcept
+    {
+        std::size_t w = 0;
+    #ifdef BITFIELD_AVX512
+        if (n >= 64 / sizeof(word_t))
+        {
+            __m512i acc = _mm512_setzero_si512();
+            for (const std::size_t step = 64 / sizeof(word_t), body = n - n % step; w < body; w += step)
+                acc = _mm512_or_si512(acc, op::v512(_mm512_loadu_si512(a + w), _mm512_loadu_si512(b + w)));
+            if (_mm512_test_epi64_mask(acc, acc) != 0) return false;
+        }
+    #endif
+    #ifdef BITFIELD_AVX2
+        if (n - w >= 32 / sizeof(word_t))
+        {
+            __m256i acc = _mm256_setzero_si256();
+            for (const std::size_t step = 32 / sizeof(word_t), body = n - n % step; w < body; w += step)
+                acc = _mm256_or_si256(acc, op::v256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + w)), _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + w))));
+            if (!_mm256_testz_si256(acc, acc)) return false;
+        }
+    #endif
+    #ifdef BITFIELD_SSE2
+        if (n - w >= 16 / sizeof(word_t))
+        {
+            __m128i acc = _mm_setzero_si128();
+            for (const std::size_t step = 16 / sizeof(word_t), body = n - n % step; w < body; w += step)
+                acc = _mm_or_si128(acc, op::v128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a + w)), _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + w))));
+            if (_mm_movemask_epi8(_mm_cmpeq_epi8(acc, _mm_setzero_si128())) != 0xFFFF) return false;
+        }
+    #endif
+        word_t acc = 0;
+        for (; w < n; ++w)
+            acc |= op::template scalar<word_t>(a[w], b[w]);
+        return acc == 0;
+    }
+
+    //three way comparison of the n words as one unsigned integer, most significant word last
+    template <typename word_t, std::size_t n>
+    constexpr int wide_compare(const word_t* a, const word_t* b) noexcept
+    {
+        for (std::size_t w = n; w-- > 0;)
+            if (a[w] != b[w]) return a[w] < b[w] ? -1 : 1;
+        return 0;
+    }
+
+    //dst = src << s (toward the most significant word), 0 <= s < n * word bits. dst must not alias src.
+    template <typename word_t, std::size_t n>
+    constexpr void wide_shift_left(word_t* dst, const word_t* src, std::size_t s) noexcept
+    {
+        constexpr std::size_t word_bits = 8 * sizeof(word_t);
+        const std::size_t words = s / word_bits, bit = s % word_bits;
+        for (std::size_t w = n; w-- > 0;)
+        {
+            word_t v = 0;
+            if (w >= words)
+            {
+                v = static_cast<word_t>(src[w - words] << bit);
+                if (bit != 0 && w > words) v |= static_cast<word_t>(src[w - words - 1] >> (word_bits - bit));
+            }
+            dst[w] = v;
+        }
+    }
+
+    //dst = src >> s (toward word 0), 0 <= s < n * word bits. dst must not alias src.
+    template <typename word_t, std::size_t n>
+    constexpr void wide_shift_right(word_t* dst, const word_t* src, std::size_t s) noexcept
+    {
+        constexpr std::size_t word_bits = 8 * sizeof(word_t);
+        const std::size_t words = s / word_bits, bit = s % word_bits;
+        for (std::size_t w = 0; w < n; ++w)
+        {
+            word_t v = 0;
+            if (w + words < n)
+            {
+                v = static_cast<word_t>(src[w + words] >> bit);
+                if (bit != 0 && w + words + 1 < n) v |= static_cast<word_t>(src[w + words + 1] << (word_bits - bit));
+            }
+            dst[w] = v;
+        }
+    }
+}
+
+//--Expression templates--
+//The bitwise operators of the wide field and the bit vector don't compute a temporary per operator. They
+//return a checked_bit_expr that records the expression, and the whole expression is evaluated word by word
+//in one pass when it is assigned, compared or converted to the field. Operands must belong to the same field
+//(or vector) type, as with the eager operators. A checked_bit_expr refers to its operands, so keep it only
+//while they are alive - "auto x = a & b;" is an expression, "field_t x = a & b;" is a field.
+namespace bitfield_detail
+{
+#if defined(BITFIELD_AVX512) || defined(BITFIELD_AVX2) || defined(BITFIELD_SSE2)
+#define BITFIELD_EXPR_SIMD 1
+    //the widest vector enabled, expressions are evaluated one of these at a time
+#if defined(BITFIELD_AVX512)
+    typedef __m512i expr_vector;
+    inline expr_vector expr_load(const void* p) noexcept { return _mm512_loadu_si512(p); }
+    inline void expr_store(void* p, const expr_vector v) noexcept { _mm512_storeu_si512(p, v); }
+    inline expr_vector expr_ones() noexcept { return _mm512_set1_epi32(-1); }
+    template <typename op> inline expr_vector expr_apply(const expr_vector a, const expr_vector b) noexcept { return op::v512(a, b); }
+#elif defined(BITFIELD_AVX2)
+    typedef __m256i expr_vector;
+    inline expr_vector expr_load(const void* p) noexcept { return _mm256_loadu_si256(static_cast<const __m256i*>(p)); }
+    inline void expr_store(void* p, const expr_vector v) noexcept { _mm256_storeu_si256(static_cast<__m256i*>(p), v); }
+    inline expr_vector expr_ones() noexcept { return _mm256_set1_epi32(-1); }
+    template <typename op> inline expr_vector expr_apply(const expr_vector a, const expr_vector b) noexcept { return op::v256(a, b); }
+#else
+    typedef __m128i expr_vector;
+    inline expr_vector expr_load(const void* p) noexcept { return _mm_loadu_si128(static_cast<const __m128i*>(p)); }
+    inline void expr_store(void* p, const expr_vector v) noexcept { _mm_storeu_si128(static_cast<__m128i*>(p), v); }
+    inline expr_vector expr_ones() noexcept { return _mm_set1_epi32(-1); }
+    template <typename op> inline expr_vector expr_apply(const expr_vector a, const expr_vector b) noexcept { return op::v128(a, b); }
+#endif
+#endif
+
+    //an operand of an expression - the words of a field, mask or vector. domain is the field type, so masks and
+    //fields of the same field mix and anything else doesn't. tail masks the valid bits of the last word.
+    template <typename domain_t, typename word_type>
+    struct expr_leaf
+    {
+        typedef domain_t domain;
+        typedef word_type word_t;
+        const word_t* words;
+        std::size_t n;
+        word_t tail;
+
+        std::size_t size() const noexcept { return n; }
+        word_t last_mask() const noexcept { return tail; }
+        word_t word(const std::size_t i) const noexcept { return words[i]; }
+    #ifdef BITFIELD_EXPR_SIMD
+        expr_vector vec(const std::size_t i) const noexcept { return expr_load(words + i); }
+    #endif
+    };
+
+    //op applied to two sub-expressions. Sub-expressions are held by value, the leaves only point at the operands.
+    template <typename op, typename lhs_t, typename rhs_t>
+    struct expr_binary
+    {
+        static_assert(std::is_same<typename lhs_t::domain, typename rhs_t::domain>::value, "operands must be of the same bit field type");
+        typedef typename lhs_t::domain domain;
+        typedef typename lhs_t::word_t word_t;
+        lhs_t lhs;
+        rhs_t rhs;
+
+        //every operator checks its own operands, so operands nested in an expression are checked too
+        expr_binary(const lhs_t& l, const rhs_t& r) noexcept : lhs(l), rhs(r) { assert(lhs.size() == rhs.size() && lhs.last_mask() == rhs.last_mask()); }
+
+        std::size_t size() const noexcept { return lhs.size(); }
+        word_t last_mask() const noexcept { return lhs.last_mask(); }
+        word_t word(const std::size_t i) const noexcept { return op::template scalar<word_t>(lhs.word(i), rhs.word(i)); }
+    #ifdef BITFIELD_EXPR_SIMD
+        expr_vector vec(const std::size_t i) const noexcept { return expr_apply<op>(lhs.vec(i), rhs.vec(i)); }
+    #endif
+    };
+
+    //~arg, the bits above the field in the last word are masked off when the expression is evaluated
+    template <typename arg_t>
+    struct expr_not
+    {
+        typedef typename arg_t::domain domain;
+        typedef typename arg_t::word_t word_t;
+        arg_t arg;
+
+        std::size_t size() const noexcept { return arg.size(); }
+        word_t last_mask() const noexcept { return arg.last_mask(); }
+        word_t word(const std::size_t i) const noexcept { return static_cast<word_t>(~arg.word(i)); }
+    #ifdef BITFIELD_EXPR_SIMD
+        expr_vector vec(const std::size_t i) const noexcept { return expr_apply<op_xor>(arg.vec(i), expr_ones()); }
+    #endif
+    };
+
+    //evaluates e into the n words of dst in one pass. dst may be one of the operands, every word is read before
+    //it is written. n is the size of dst, a constant for wide fields, so the vector loop of a field narrower
+    //than a vector is dropped at compile time rather than left to be warned about.
+    template <typename node_t>
+    inline void expr_assign(typename node_t::word_t* dst, const node_t& e, const std::size_t n) noexcept
+    {
+        assert(e.size() == n);
+        std::size_t w = 0;
+    #ifdef BITFIELD_EXPR_SIMD
+        constexpr std::size_t step = sizeof(expr_vector) / sizeof(typename node_t::word_t);
+        for (const std::size_t body = n - n % step; w < body; w += step)
+            expr_store(dst + w, e.vec(w));
+    #endif
+        for (; w < n; ++w) dst[w] = e.word(w);
+        if (n != 0) dst[n - 1] &= e.last_mask();
+    }
+
+    //true if every bit of e is zero, evaluated in one pass without storing the result
+    template <typename node_t>
+    inline bool expr_none(const node_t& e) noexcept
+    {
+        typedef typename node_t::word_t word_t;
+        const std::size_t n = e.size();
+        if (n == 0) return true;
+        //the last word is tested on its own so the bits above the field can be masked off
+        const std::size_t body = n - 1;
+        std::size_t w = 0;
+    #ifdef BITFIELD_EXPR_SIMD
+        constexpr std::size_t step = sizeof(expr_vector) / sizeof(word_t);
+        if (body >= step)
+        {
+            expr_vector acc = e.vec(0);
+            for (w = step; w + step <= body; w += step)
+                acc = expr_apply<op_or>(acc, e.vec(w));
+            alignas(sizeof(expr_vector)) word_t lanes[step];
+            expr_store(lanes, acc);
+            word_t any = 0;
+            for (std::size_t l = 0; l < step; ++l) any |= lanes[l];
+            if (any != 0) return false;
+        }
+    #endif
+        word_t any = 0;
+        for (; w < body; ++w) any |= e.word(w);
+        return (any | (e.word(body) & e.last_mask())) == 0;
+    }
+
+    //number of set bits of e
+    template <typename node_t>
+    inline std::size_t expr_count(const node_t& e) noexcept
+    {
+        const std::size_t n = e.size();
+        if (n == 0) return 0;
+        std::size_t count = 0;
+        for (std::size_t w = 0; w + 1 < n; ++w) count += popcount(e.word(w));
+        return count + popcount(static_cast<typename node_t::word_t>(e.word(n - 1) & e.last_mask()));
+    }
+}
+
+//a lazily evaluated bitwise expression over wide fields, masks or bit vectors of one type, see above
+template <typename node_t>
+class checked_bit_expr
+{
+public:
+    typedef typename node_t::domain field_t;
+    typedef node_t node_type;
+
+private:
+    node_t node;
+
+    template <typename op, typename rhs_t>
+    using binary_t = checked_bit_expr<bitfield_detail::expr_binary<op, node_t, typename std::decay<decltype(std::declval<const rhs_t&>().expr_node())>::type>>;
+
+public:
+    explicit checked_bit_expr(const node_t& n) noexcept : node(n) {}
+    //used by the operators to build larger expressions
+    const node_t& expr_node() const noexcept { return node; }
+
+    //--Evaluation--
+    field_t eval() const { return field_t(*this); }
+    operator field_t() const { return eval(); }
+    std::size_t count() const noexcept { return bitfield_detail::expr_count(node); }
+
+    //--Operations--
+    template <typename rhs_t> binary_t<bitfield_detail::op_and, rhs_t> operator&(const rhs_t& rhs) const noexcept { return binary_t<bitfield_detail::op_and, rhs_t>({ node, rhs.expr_node() }); }
+    template <typename rhs_t> binary_t<bitfield_detail::op_or,  rhs_t> operator|(const rhs_t& rhs) const noexcept { return binary_t<bitfield_detail::op_or,  rhs_t>({ node, rhs.expr_node() }); }
+    template <typename rhs_t> binary_t<bitfield_detail::op_xor, rhs_t> operator^(const rhs_t& rhs) const noexcept { return binary_t<bitfield_detail::op_xor, rhs_t>({ node, rhs.expr_node() }); }
+    checked_bit_expr<bitfield_detail::expr_not<node_t>> operator~() const noexcept { return checked_bit_expr<bitfield_detail::expr_not<node_t>>({ node }); }
+
+    //comparisons run over the expression without storing it
+    bool operator==(const std::nullptr_t) const noexcept { return bitfield_detail::expr_none(node); }
+    bool operator!=(const std::nullptr_t) const noexcept { return !bitfield_detail::expr_none(node); }
+    friend bool operator==(const std::nullptr_t, const checked_bit_expr& rhs) noexcept { return rhs == nullptr; }
+    friend bool operator!=(const std::nullptr_t, const checked_bit_expr& rhs) noexcept { return rhs != nullptr; }
+    template <typename rhs_t> bool operator==(const rhs_t& rhs) const noexcept { return (*this ^ rhs) == nullptr; }
+    template <typename rhs_t> bool operator!=(const rhs_t& rhs) const noexcept { return (*this ^ rhs) != nullptr; }
+    bool operator!() const noexcept { return *this == nullptr; }
+    explicit operator bool() const noexcept { return *this != nullptr; }
+
+    //shifts move bits between words, so the expression is evaluated first
+    field_t operator<<(const unsigned int s) const { return eval() << s; }
+    field_t operator>>(const unsigned int s) const { return eval() >> s; }
+
+    //--Bit queries--
+    //the queries of the wide field, run over the expression without storing it
+    template <typename rhs_t> bool any(const rhs_t& mask) const noexcept { return (*this & mask) != nullptr; }
+    template <typename rhs_t> bool all(const rhs_t& mask) const noexcept { return (~*this & mask) == nullptr; }
+    template <typename rhs_t> bool none(const rhs_t& mask) const noexcept { return (*this & mask) == nullptr; }
+    //position of the lowest/highest set bit, numbered from 1 as in set_bit. 0 if no bit is set.
+    unsigned int first_set() const noexcept
+    {
+        const std::size_t n = node.size();
+        for (std::size_t w = 0; w < n; ++w)
+            if (const word_t v = masked_word(w)) return static_cast<unsigned int>(w * word_bits) + bitfield_detail::first_set(v);
+        return 0;
+    }
+    unsigned int last_set() const noexcept
+    {
+        for (std::size_t w = node.size(); w-- > 0;)
+            if (const word_t v = masked_word(w)) return static_cast<unsigned int>(w * word_bits) + bitfield_detail::last_set(v);
+        return 0;
+    }
+    //range over the set bits - for (auto bit : (a & b).each_set_bit()). The range holds the evaluated
+    //expression and its iterators refer to it, so it can outlive the operands but not the loop.
+    class bit_range
+    {
+        field_t value;
+    public:
+        explicit bit_range(const checked_bit_expr& e) : value(e.eval()) {}
+        auto begin() const noexcept { return value.each_set_bit().begin(); }
+        auto end() const noexcept { return value.each_set_bit().end(); }
+    };
+    bit_range each_set_bit() const { return bit_range(*this); }
+
+private:
+    typedef typename node_t::word_t word_t;
+    static constexpr std::size_t word_bits = 8 * sizeof(word_t);
+    word_t masked_word(const std::size_t w) const noexcept { return w + 1 == node.size() ? static_cast<word_t>(node.word(w) & node.last_mask()) : node.word(w); }
+};
+
+//free function forms of the bit queries for expressions, see bitfield_count
+template <typename node_t>
+std::size_t bitfield_count(const checked_bit_expr<node_t>& e) noexcept { return e.count(); }
+template <typename node_t>
+bool bitfield_any(const checked_bit_expr<node_t>& e) noexcept { return e != nullptr; }
+template <typename node_t, typename mask_type>
+bool bitfield_any(const checked_bit_expr<node_t>& e, const mask_type& mask) noexcept { return e.any(mask); }
+template <typename node_t, typename mask_type>
+bool bitfield_all(const checked_bit_expr<node_t>& e, const mask_type& mask) noexcept { return e.all(mask); }
+template <typename node_t>
+bool bitfield_none(const checked_bit_expr<node_t>& e) noexcept { return e == nullptr; }
+template <typename node_t, typename mask_type>
+bool bitfield_none(const checked_bit_expr<node_t>& e, const mask_type& mask) noexcept { return e.none(mask); }
+template <typename node_t>
+unsigned int bitfield_first_set(const checked_bit_expr<node_t>& e) noexcept { return e.first_set(); }
+template <typename node_t>
+unsigned int bitfield_last_set(const checked_bit_expr<node_t>& e) noexcept { return e.last_set(); }
+template <typename node_t>
+typename checked_bit_expr<node_t>::bit_range bitfield_each_set_bit(const checked_bit_expr<node_t>& e) { return e.each_set_bit(); }
+
+//forward declaration of checked_wide_bit_mask
+//bits - number of flags in the field
+//word_t - unsigned integer type of the words the bits are stored in
+template <bitfield_unique_id* unique_id, std::size_t bits, typename word_t = std::uint64_t>
+class checked_wide_bit_mask;
+
+template <bitfield_unique_id* unique_id, std::size_t bits, typename word_t = std::uint64_t>
+class alignas(bitfield_detail::wide_alignment<word_t, (bits + 8 * sizeof(word_t) - 1) / (8 * sizeof(word_t))>()) checked_wide_bit_field
+{
+    static_assert(std::is_unsigned<word_t>::value, "word_t must be an unsigned integer type");
+    static_assert(bits > 0, "a bit field must hold at least one bit");
+
+public:
+    static constexpr std::size_t word_bits = 8 * sizeof(word_t);
+    static constexpr std::size_t word_count = (bits + word_bits - 1) / word_bits;
+    //the valid bits of the last word, bits above "bits" are always kept zero
+    static constexpr word_t tail_mask = (bits % word_bits == 0) ? static_cast<word_t>(~word_t(0)) : static_cast<word_t>((word_t(1) << (bits % word_bits)) - 1);
+
+private:
+    //the actual field, word 0 holds bits 1 to word_bits
+    word_t words[word_count];
+
+    //private constructor for results written by the kernels
+    explicit checked_wide_bit_field(bitfield_detail::uninitialized_t) noexcept {}
+
+    //mask with the single bit "bit" set in word w
+    static checked_wide_bit_mask<unique_id, bits, word_t> single_bit(const std::size_t w, const word_t bit) noexcept
+    {
+        checked_wide_bit_mask<unique_id, bits, word_t> result;
+        result.words[w] = bit;
+        return result;
+    }
+
+public:
+    //For convenience with macros, we declare checked_wide_bit_field::fieldbit_t
+    friend class checked_wide_bit_mask<unique_id, bits, word_t>;
+    typedef checked_wide_bit_mask<unique_id, bits, word_t> fieldbit_t;
+    //expression templates, see checked_bit_expr
+    typedef bitfield_detail::expr_leaf<checked_wide_bit_field, word_t> expr_leaf_t;
+    template <typename op, typename rhs_t>
+    using expr_t = checked_bit_expr<bitfield_detail::expr_binary<op, expr_leaf_t, typename std::decay<decltype(std::declval<const rhs_t&>().expr_node())>::type>>;
+    expr_leaf_t expr_node() const noexcept { return expr_leaf_t{ words, word_count, tail_mask }; }
+
+    //--Constructors--
+    //default constructor - all words are zeroed
+    constexpr checked_wide_bit_field() noexcept : words{} {}
+    //copy constructor from bit mask
+    constexpr checked_wide_bit_field(const fieldbit_t& rhs) noexcept : words{} { for (std::size_t w = 0; w < word_count; ++w) words[w] = rhs.words[w]; }
+    //copy constructor from 0//NULL/nullptr
+    constexpr checked_wide_bit_field(const std::nullptr_t) noexcept : words{} {}
+    //evaluates an expression of this field type
+    template <typename node_t>
+    checked_wide_bit_field(const checked_bit_expr<node_t>& rhs) noexcept
+    {
+        static_assert(std::is_same<typename node_t::domain, checked_wide_bit_field>::value, "expression must be of the same bit field type");
+        bitfield_detail::expr_assign(words, rhs.expr_node(), word_count);
+    }
+
+    //--Copy Assignments--
+    //copy assignment operator from bit mask
+    checked_wide_bit_field& operator=(const fieldbit_t& rhs) noexcept { for (std::size_t w = 0; w < word_count; ++w) words[w] = rhs.words[w]; return *this; }
+    //assignment operator to allow for assigning 0 (clearing bits)
+    checked_wide_bit_field& operator=(const std::nullptr_t&) noexcept { for (std::size_t w = 0; w < word_count; ++w) words[w] = 0; return *this; }
+    //assignment from an expression, evaluated straight into the field. The expression may use the field itself.
+    template <typename node_t>
+    checked_wide_bit_field& operator=(const checked_bit_expr<node_t>& rhs) noexcept
+    {
+        static_assert(std::is_same<typename node_t::domain, checked_wide_bit_field>::value, "expression must be of the same bit field type");
+        bitfield_detail::expr_assign(words, rhs.expr_node(), word_count);
+        return *this;
+    }
+
+    //--Operations--
+    //0/NULL/nullptr comparison operators
+    friend bool operator==(const std::nullptr_t, const checked_wide_bit_field& rhs) noexcept { return rhs == nullptr; }
+    friend bool operator!=(const std::nullptr_t, const checked_wide_bit_field& rhs) noexcept { return rhs != nullptr; }
+    bool operator==(const std::nullptr_t) const noexcept { return bitfield_detail::wide_none<bitfield_detail::op_or>(words, words, word_count); }
+    bool operator!=(const std::nullptr_t) const noexcept { return !(*this == nullptr); }
+    //0/NULL/nullptr bitwise operators
+    checked_wide_bit_field  operator& (const std::nullptr_t) const noexcept { return checked_wide_bit_field(); }
+    checked_wide_bit_field  operator| (const std::nullptr_t) const noexcept { return *this; }
+    checked_wide_bit_field  operator^ (const std::nullptr_t) const noexcept { return *this; }
+    checked_wide_bit_field& operator&=(const std::nullptr_t) noexcept { return *this = nullptr; }
+    checked_wide_bit_field& operator|=(const std::nullptr_t) noexcept { return *this; }
+    checked_wide_bit_field& operator^=(const std::nullptr_t) noexcept { return *this; }
+    //bitfield to bitfield comparison operators, the words compare as one unsigned integer
+    bool operator==(const checked_wide_bit_field& rhs) const noexcept { return bitfield_detail::wide_none<bitfield_detail::op_xor>(words, rhs.words, word_count); }
+    bool operator!=(const checked_wide_bit_field& rhs) const noexcept { return !(*this == rhs); }
+    bool operator<=(const checked_wide_bit_field& rhs) const noexcept { return bitfield_detail::wide_compare<word_t, word_count>(words, rhs.words) <= 0; }
+    bool operator>=(const checked_wide_bit_field& rhs) const noexcept { return bitfield_detail::wide_compare<word_t, word_count>(words, rhs.words) >= 0; }
+    bool operator< (const checked_wide_bit_field& rhs) const noexcept { return bitfield_detail::wide_compare<word_t, word_count>(words, rhs.words) <  0; }
+    bool operator> (const checked_wide_bit_field& rhs) const noexcept { return bitfield_detail::wide_compare<word_t, word_count>(words, rhs.words) >  0; }
+    //bitwise operators with a field, mask or expression of this field type, these return an expression
+    checked_bit_expr<bitfield_detail::expr_not<expr_leaf_t>> operator~ () const noexcept { return checked_bit_expr<bitfield_detail::expr_not<expr_leaf_t>>({ expr_node() }); }
+    template <typename rhs_t> expr_t<bitfield_detail::op_and, rhs_t> operator& (const rhs_t& rhs) const noexcept { return expr_t<bitfield_detail::op_and, rhs_t>({ expr_node(), rhs.expr_node() }); }
+    template <typename rhs_t> expr_t<bitfield_detail::op_or,  rhs_t> operator| (const rhs_t& rhs) const noexcept { return expr_t<bitfield_detail::op_or,  rhs_t>({ expr_node(), rhs.expr_node() }); }
+    template <typename rhs_t> expr_t<bitfield_detail::op_xor, rhs_t> operator^ (const rhs_t& rhs) const noexcept { return expr_t<bitfield_detail::op_xor, rhs_t>({ expr_node(), rhs.expr_node() }); }
+    //bitfield to bitfield bitwise assignment
+    checked_wide_bit_field& operator&=(const checked_wide_bit_field& rhs) noexcept { bitfield_detail::wide_apply<bitfield_detail::op_and>(words, words, rhs.words, word_count); return *this; }
+    checked_wide_bit_field& operator|=(const checked_wide_bit_field& rhs) noexcept { bitfield_detail::wide_apply<bitfield_detail::op_or>(words, words, rhs.words, word_count); return *this; }
+    checked_wide_bit_field& operator^=(const checked_wide_bit_field& rhs) noexcept { bitfield_detail::wide_apply<bitfield_detail::op_xor>(words, words, rhs.words, word_count); return *this; }
+    //bitfield to bitmask comparison operators
+    bool operator==(const fieldbit_t& rhs) const noexcept { return bitfield_detail::wide_none<bitfield_detail::op_xor>(words, rhs.words, word_count); }
+    bool operator!=(const fieldbit_t& rhs) const noexcept { return !(*this == rhs); }
+    bool operator<=(const fieldbit_t& rhs) const noexcept { return bitfield_detail::wide_compare<word_t, word_count>(words, rhs.words) <= 0; }
+    bool operator>=(const fieldbit_t& rhs) const noexcept { return bitfield_detail::wide_compare<word_t, word_count>(words, rhs.words) >= 0; }
+    bool operator< (const fieldbit_t& rhs) const noexcept { return bitfield_detail::wide_compare<word_t, word_count>(words, rhs.words) <  0; }
+    bool operator> (const fieldbit_t& rhs) const noexcept { return bitfield_detail::wide_compare<word_t, word_count>(words, rhs.words) >  0; }
+    //bitfield to bitmask bitwise operators
+    checked_wide_bit_field& operator&=(const fieldbit_t& rhs) noexcept { bitfield_detail::wide_apply<bitfield_detail::op_and>(words, words, rhs.words, word_count); return *this; }
+    checked_wide_bit_field& operator|=(const fieldbit_t& rhs) noexcept { bitfield_detail::wide_apply<bitfield_detail::op_or>(words, words, rhs.words, word_count); return *this; }
+    checked_wide_bit_field& operator^=(const fieldbit_t& rhs) noexcept { bitfield_detail::wide_apply<bitfield_detail::op_xor>(words, words, rhs.words, word_count); return *this; }
+    //bitfield to expression bitwise assignment, one pass over the field
+    template <typename node_t> checked_wide_bit_field& operator&=(const checked_bit_expr<node_t>& rhs) noexcept { return *this = *this & rhs; }
+    template <typename node_t> checked_wide_bit_field& operator|=(const checked_bit_expr<node_t>& rhs) noexcept { return *this = *this | rhs; }
+    template <typename node_t> checked_wide_bit_field& operator^=(const checked_bit_expr<node_t>& rhs) noexcept { return *this = *this ^ rhs; }
+    //bitfield to expression comparison operators, evaluated without a temporary
+    template <typename node_t> bool operator==(const checked_bit_expr<node_t>& rhs) const noexcept { return (rhs ^ *this) == nullptr; }
+    template <typename node_t> bool operator!=(const checked_bit_expr<node_t>& rhs) const noexcept { return (rhs ^ *this) != nullptr; }
+
+    //shift operators, bits shifted past the last flag are discarded
+    checked_wide_bit_field operator<< (const unsigned int s) const noexcept
+    {
+        assert(s <= bits);
+        checked_wide_bit_field result;
+        if (s < bits)
+        {
+            bitfield_detail::wide_shift_left<word_t, word_count>(result.words, words, s);
+            result.words[word_count - 1] &= tail_mask;
+        }
+        return result;
+    }
+    checked_wide_bit_field operator>> (const unsigned int s) const noexcept
+    {
+        assert(s <= bits);
+        checked_wide_bit_field result;
+        if (s < bits) bitfield_detail::wide_shift_right<word_t, word_count>(result.words, words, s);
+        return result;
+    }
+    checked_wide_bit_field& operator<<=(const unsigned int s) noexcept { return *this = *this << s; }
+    checked_wide_bit_field& operator>>=(const unsigned int s) noexcept { return *this = *this >> s; }
+
+    //bit queries
+    //number of set bits
+    unsigned int count() const noexcept
+    {
+        unsigned int n = 0;
+        for (std::size_t w = 0; w < word_count; ++w) n += bitfield_detail::popcount(words[w]);
+        return n;
+    }
+    //any/all/none of the bits of mask are set
+    bool any(const checked_wide_bit_field& mask) const noexcept { return !none(mask); }
+    bool all(const checked_wide_bit_field& mask) const noexcept { return bitfield_detail::wide_none<bitfield_detail::op_andnot>(mask.words, words, word_count); }
+    bool none(const checked_wide_bit_field& mask) const noexcept { return bitfield_detail::wide_none<bitfield_detail::op_and>(words, mask.words, word_count); }
+    //position of the lowest/highest set bit, numbered from 1 as in set_bit. 0 if no bit is set.
+    unsigned int first_set() const noexcept
+    {
+        for (std::size_t w = 0; w < word_count; ++w)
+            if (words[w] != 0) return static_cast<unsigned int>(w * word_bits) + bitfield_detail::first_set(words[w]);
+        return 0;
+    }
+    unsigned int last_set() const noexcept
+    {
+        for (std::size_t w = word_count; w-- > 0;)
+            if (words[w] != 0) return static_cast<unsigned int>(w * word_bits) + bitfield_detail::last_set(words[w]);
+        return 0;
+    }
+
+    //iterates over the set bits, lowest first, yielding a fieldbit_t with just that bit set.
+    //The iterator refers to the field, which must outlive it.
+    class bit_iterator
+    {
+    public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef fieldbit_t value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef void pointer;
+        typedef fieldbit_t reference;
+
+    private:
+        const word_t* words;
+        //current word and the bits of it not yet visited
+        std::size_t index;
+        word_t rest;
+
+        void skip_zero_words() noexcept { while (rest == 0 && ++index < word_count) rest = words[index]; }
+
+    public:
+        bit_iterator() noexcept : words(nullptr), index(word_count), rest(0) {}
+        explicit bit_iterator(const word_t* field_words) noexcept : words(field_words), index(0), rest(field_words[0]) { skip_zero_words(); }
+
+        fieldbit_t operator*() const noexcept { return single_bit(index, static_cast<word_t>(rest & (~rest + 1))); }
+        //position of the current bit, numbered from 1 as in set_bit
+        unsigned int position() const noexcept { return static_cast<unsigned int>(index * word_bits) + bitfield_detail::first_set(rest); }
+
+        bit_iterator& operator++() noexcept { rest &= rest - 1; skip_zero_words(); return *this; }
+        bit_iterator operator++(int) noexcept { bit_iterator old = *this; ++*this; return old; }
+        bool operator==(const bit_iterator& rhs) const noexcept { return index == rhs.index && rest == rhs.rest; }
+        bool operator!=(const bit_iterator& rhs) const noexcept { return !(*this == rhs); }
+    };
+    class bit_range
+    {
+        const word_t* words;
+    public:
+        explicit bit_range(const word_t* field_words) noexcept : words(field_words) {}
+        bit_iterator begin() const noexcept { return bit_iterator(words); }
+        bit_iterator end() const noexcept { return bit_iterator(); }
+    };
+    //range over the set bits - for (fieldbit_t bit : field.each_set_bit())
+    bit_range each_set_bit() const noexcept { return bit_range(words); }
+
+    //logical operators
+    bool operator!() const noexcept { return *this == nullptr; }
+
+    //conversion to bool, explicit for the same reason as checked_bit_field
+    explicit operator bool() const noexcept { return *this != nullptr; }
+
+    //deleted operators
+    checked_wide_bit_field operator-()  = delete;
+    checked_wide_bit_field operator++() = delete;
+    checked_wide_bit_field operator--() = delete;
+    template<class T> checked_wide_bit_field operator+(T)  const = delete;
+    template<class T> checked_wide_bit_field operator*(T)  const = delete;
+    template<class T> checked_wide_bit_field operator/(T)  const = delete;
+    template<class T> checked_wide_bit_field operator%(T)  const = delete;
+    template<class T> checked_wide_bit_field operator+=(T) const = delete;
+    template<class T> checked_wide_bit_field operator-=(T) const = delete;
+    template<class T> checked_wide_bit_field operator*=(T) const = delete;
+    template<class T> checked_wide_bit_field operator/=(T) const = delete;
+    template<class T> checked_wide_bit_field operator%=(T) const = delete;
+};
+
+template <bitfield_unique_id* unique_id, std::size_t bits, typename word_t>
+class alignas(bitfield_detail::wide_alignment<word_t, (bits + 8 * sizeof(word_t) - 1) / (8 * sizeof(word_t))>()) checked_wide_bit_mask
+{
+public:
+    // Corresponding bit field type.
+    friend class checked_wide_bit_field<unique_id, bits, word_t>;
+    typedef checked_wide_bit_field<unique_id, bits, word_t> field_t;
+    static constexpr std::size_t word_bits = field_t::word_bits;
+    static constexpr std::size_t word_count = field_t::word_count;
+
+private:
+    //the bit mask
+    word_t words[word_count];
+
+public:
+    //static factory constructors, bits are numbered from 1 as in checked_bit_mask::set_bit
+    template <std::size_t i> static constexpr checked_wide_bit_mask set_bit() noexcept
+    {
+        static_assert(i <= bits, "bit to set must be within bounds of field");
+        checked_wide_bit_mask result;
+        if (i > 0) result.words[(i - 1) / word_bits] = static_cast<word_t>(word_t(1) << ((i - 1) % word_bits));
+        return result;
+    }
+    //sets the low bits of the field from an integer
+    template <unsigned long long i> static constexpr checked_wide_bit_mask set_bits() noexcept
+    {
+        static_assert(bits >= 64 || i < (1ull << bits), "value is greater than number of bit combinations");
+        checked_wide_bit_mask result;
+        for (std::size_t w = 0; w < word_count && w * word_bits < 64; ++w)
+            result.words[w] = static_cast<word_t>(i >> (w * word_bits));
+        return result;
+    }
+    //every bit of the field set
+    static constexpr checked_wide_bit_mask all() noexcept { return ~checked_wide_bit_mask(); }
+
+    //expression templates, see checked_bit_expr
+    typedef typename field_t::expr_leaf_t expr_leaf_t;
+    expr_leaf_t expr_node() const noexcept { return expr_leaf_t{ words, word_count, field_t::tail_mask }; }
+
+    //--Constructors--
+    //default constructor - all words are zeroed
+    explicit constexpr checked_wide_bit_mask() noexcept : words{} {}
+    constexpr checked_wide_bit_mask(const std::nullptr_t) noexcept : words{} {}
+
+    //--Operations--
+    //bitmask to bitfield comparison operators
+    bool operator==(const field_t& rhs) const noexcept { return rhs == *this; }
+    bool operator!=(const field_t& rhs) const noexcept { return rhs != *this; }
+    bool operator<=(const field_t& rhs) const noexcept { return rhs >= *this; }
+    bool operator>=(const field_t& rhs) const noexcept { return rhs <= *this; }
+    bool operator< (const field_t& rhs) const noexcept { return rhs >  *this; }
+    bool operator> (const field_t& rhs) const noexcept { return rhs <  *this; }
+
+    //bitmask to bitmask bitwise operators, evaluated word by word so masks can be built at compile time
+    constexpr checked_wide_bit_mask operator~() const noexcept
+    {
+        checked_wide_bit_mask result;
+        for (std::size_t w = 0; w < word_count; ++w) result.words[w] = static_cast<word_t>(~words[w]);
+        result.words[word_count - 1] &= field_t::tail_mask;
+        return result;
+    }
+    constexpr checked_wide_bit_mask operator|(const checked_wide_bit_mask& rhs) const noexcept
+    {
+        checked_wide_bit_mask result;
+        for (std::size_t w = 0; w < word_count; ++w) result.words[w] = words[w] | rhs.words[w];
+        return result;
+    }
+    constexpr checked_wide_bit_mask operator&(const checked_wide_bit_mask& rhs) const noexcept
+    {
+        checked_wide_bit_mask result;
+        for (std::size_t w = 0; w < word_count; ++w) result.words[w] = words[w] & rhs.words[w];
+        return result;
+    }
+    constexpr checked_wide_bit_mask operator^(const checked_wide_bit_mask& rhs) const noexcept
+    {
+        checked_wide_bit_mask result;
+        for (std::size_t w = 0; w < word_count; ++w) result.words[w] = words[w] ^ rhs.words[w];
+        return result;
+    }
+
+    //bitmask to bitfield or expression bitwise operators, these return an expression
+    template <typename rhs_t> typename field_t::template expr_t<bitfield_detail::op_or,  rhs_t> operator|(const rhs_t& rhs) const noexcept { return typename field_t::template expr_t<bitfield_detail::op_or,  rhs_t>({ expr_node(), rhs.expr_node() }); }
+    template <typename rhs_t> typename field_t::template expr_t<bitfield_detail::op_and, rhs_t> operator&(const rhs_t& rhs) const noexcept { return typename field_t::template expr_t<bitfield_detail::op_and, rhs_t>({ expr_node(), rhs.expr_node() }); }
+    template <typename rhs_t> typename field_t::template expr_t<bitfield_detail::op_xor, rhs_t> operator^(const rhs_t& rhs) const noexcept { return typename field_t::template expr_t<bitfield_detail::op_xor, rhs_t>({ expr_node(), rhs.expr_node() }); }
+};
+
+//free function forms of the bit queries for wide fields, see bitfield_count
+template <bitfield_unique_id* unique_id, std::size_t bits, typename word_t>
+unsigned int bitfield_count(const checked_wide_bit_field<unique_id, bits, word_t>& field) noexcept { return field.count(); }
+template <bitfield_unique_id* unique_id, std::size_t bits, typename word_t>
+bool bitfield_any(const checked_wide_bit_field<unique_id, bits, word_t>& field) noexcept { return field != nullptr; }
+template <bitfield_unique_id* unique_id, std::size_t bits, typename word_t, typename mask_type>
+bool bitfield_any(const checked_wide_bit_field<unique_id, bits, word_t>& field, const mask_type& mask) noexcept { return field.any(mask); }
+template <bitfield_unique_id* unique_id, std::size_t bits, typename word_t, typename mask_type>
+bool bitfield_all(const checked_wide_bit_field<unique_id, bits, word_t>& field, const mask_type& mask) noexcept { return field.all(mask); }
+template <bitfield_unique_id* unique_id, std::size_t bits, typename word_t>
+bool bitfield_none(const checked_wide_bit_field<unique_id, bits, word_t>& field) noexcept { return field == nullptr; }
+template <bitfield_unique_id* unique_id, std::size_t bits, typename word_t, typename mask_type>
+bool bitfield_none(const checked_wide_bit_field<unique_id, bits, word_t>& field, const mask_type& mask) noexcept { return field.none(mask); }
+template <bitfield_unique_id* unique_id, std::size_t bits, typename word_t>
+unsigned int bitfield_first_set(const checked_wide_bit_field<unique_id, bits, word_t>& field) noexcept { return field.first_set(); }
+template <bitfield_unique_id* unique_id, std::size_t bits, typename word_t>
+unsigned int bitfield_last_set(const checked_wide_bit_field<unique_id, bits, word_t>& field) noexcept { return field.last_set(); }
+template <bitfield_unique_id* unique_id, std::size_t bits, typename word_t>
+typename checked_wide_bit_field<unique_id, bits, word_t>::bit_range bitfield_each_set_bit(const checked_wide_bit_field<unique_id, bits, word_t>& field) noexcept { return field.each_set_bit(); }
+
+#ifdef _BITFIELD
+//wide bit field type declaration - WIDE_BIT_FIELD(512, mybitfield);
+#define WIDE_BIT_FIELD( bits, bitfield_t ) extern bitfield_unique_id ui_##bitfield_t; typedef checked_wide_bit_field<&ui_##bitfield_t, bits> bitfield_t
+#else
+//without _BITFIELD every wide field of the same size is the same type, as plain integers would be
+#define WIDE_BIT_FIELD( bits, bitfield_t ) typedef checked_wide_bit_field<&bitfield_unchecked_id, bits> bitfield_t
+#endif
+//wide bit mask declaration - WIDE_BIT_MASK(mybitfield, mask300, 300);
+#define WIDE_BIT_MASK( bitfield_t, label, bit_pos ) static constexpr bitfield_t::fieldbit_t label = bitfield_t::fieldbit_t::set_bit<bit_pos>()
+//complex wide bit constant declaration - WIDE_BIT_MASKS(mybitfield, complexbitmask) = mask1 | mask300;
+#define WIDE_BIT_MASKS( bitfield_t, label ) static constexpr bitfield_t::fieldbit_t label
@@ -0,0 +1,286 @@
+/*Copyright 2017 Jonathan Campbell
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.*/
+//checked_bit_file - arrays of BIT_FIELD records saved to disk and mapped back in place, without a copy
+#pragma once
+#include "Bitfield.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#if defined(_WIN32)
+#include <io.h>
+//without the min/max macros and the rarely used parts of Win32, restoring the caller's settings afterwards
+#pragma push_macro("NOMINMAX")
+#pragma push_macro("WIN32_LEAN_AND_MEAN")
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#pragma pop_macro("WIN32_LEAN_AND_MEAN")
+#pragma pop_macro("NOMINMAX")
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+//The file is a 64 byte header followed by the words of the records, as they are laid out in memory.
+//The words start on a cache line, so the mapped records are as aligned as the mapping itself.
+struct bitfield_file_header
+{
+    char magic[8];              //"BITFIELD"
+    std::uint32_t version;      //format version, 1
+    std::uint32_t byte_order;   //0x01020304 as stored by the machine that wrote the file
+    std::uint32_t word_size;    //sizeof the word type of the field
+    std::uint32_t reserved;
+    std::uint64_t type_hash;    //hash of the type name given to BIT_FILE
+    std::uint64_t count;        //number of records
+    std::uint8_t padding[24];
+};
+static_assert(sizeof(bitfield_file_header) == 64, "the header must fill one cache line");
+
+//result of opening or saving a file
+enum class bitfield_file_status
+{
+    ok,
+    cannot_open,        //the file could not be opened, created or written
+    cannot_map,         //the file could not be mapped
+    not_a_bitfield_file,//bad magic or version, or shorter than its header says
+    wrong_word_size,    //saved from a field with another word type
+    wrong_byte_order,   //saved on a machine of the other endianness
+    wrong_type          //saved from another BIT_FIELD type
+};
+
+//how the records are mapped
+enum class bitfield_file_mode
+{
+    read_only,          //the records are const
+    copy_on_write       //the records may be changed, changes stay private to the process and are never written back
+};
+
+namespace bitfield_detail
+{
+    constexpr char file_magic[8] = { 'B', 'I', 'T', 'F', 'I', 'E', 'L', 'D' };
+    constexpr std::uint32_t file_version = 1;
+    constexpr std::uint32_t file_byte_order = 0x01020304;
+
+    //64 bit FNV-1a, the type hash of a file. It only depends on the characters of the name, so it is the same
+    //for every compiler, platform and for both the checked and the plain build.
+    constexpr std::uint64_t fnv1a(const char* s) noexcept
+    {
+        std::uint64_t h = 14695981039346656037ull;
+        for (; *s != 0; ++s) h = (h ^ static_cast<unsigned char>(*s)) * 1099511628211ull;
+        return h;
+    }
+}
+
+//A read-only or copy-on-write mapping of a file written by save. Opening checks the header and maps the file,
+//it doesn't read the records, so it costs the same for any number of them - pages are loaded as they are used.
+//type_hash tells apart files of different record types, declare the type through BIT_FILE with its name.
+template <typename field_type, std::uint64_t type_hash>
+class checked_bit_file
+{
+public:
+    typedef bitfield_traits<field_type> traits;
+    typedef typename traits::field_t field_t;
+    typedef typename traits::word_t word_t;
+
+private:
+    void* view;             //the whole file, header included
+    std::size_t view_size;
+    std::size_t record_count;
+    bitfield_file_mode view_mode;
+
+    word_t* words() const noexcept { return reinterpret_cast<word_t*>(static_cast<char*>(view) + sizeof(bitfield_file_header)); }
+
+    static bitfield_file_status check(const bitfield_file_header& h, const std::size_t file_size) noexcept
+    {
+        if (std::memcmp(h.magic, bitfield_detail::file_magic, sizeof(h.magic)) != 0 || h.version != bitfield_detail::file_version)
+            return bitfield_file_status::not_a_bitfield_file;
+        if (h.byte_order != bitfield_detail::file_byte_order) return bitfield_file_status::wrong_byte_order;
+        if (h.word_size != sizeof(word_t)) return bitfield_file_status::wrong_word_size;
+        if (h.type_hash != type_hash) return bitfield_file_status::wrong_type;
+        if (h.count > (file_size - sizeof(bitfield_file_header)) / sizeof(word_t)) return bitfield_file_status::not_a_bitfield_file;
+        return bitfield_file_status::ok;
+    }
+
+    //maps the whole file, view is left null on failure
+    bitfield_file_status map(const char* path, const bitfield_file_mode mode) noexcept
+    {
+        const bool cow = mode == bitfield_file_mode::copy_on_write;
+    #if defined(_WIN32)
+        const HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE) return bitfield_file_status::cannot_open;
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(file, &size))
+        {
+            CloseHandle(file);
+            return bitfield_file_status::cannot_open;
+        }
+        if (static_cast<std::uint64_t>(size.QuadPart) < sizeof(bitfield_file_header))
+        {
+            CloseHandle(file);
+            return bitfield_file_status::not_a_bitfield_file;
+        }
+        const HANDLE mapping = CreateFileMappingA(file, nullptr, cow ? PAGE_WRITECOPY : PAGE_READONLY, 0, 0, nullptr);
+        CloseHandle(file);
+        if (mapping == nullptr) return bitfield_file_status::cannot_map;
+        view = MapViewOfFile(mapping, cow ? FILE_MAP_COPY : FILE_MAP_READ, 0, 0, 0);
+        CloseHandle(mapping);
+        if (view == nullptr) return bitfield_file_status::cannot_map;
+        view_size = static_cast<std::size_t>(size.QuadPart);
+    #else
+        const int fd = ::open(path, O_RDONLY);
+        if (fd < 0) return bitfield_file_status::cannot_open;
+        struct stat st;
+        if (::fstat(fd, &st) != 0)
+        {
+            ::close(fd);
+            return bitfield_file_status::cannot_open;
+        }
+        if (static_cast<std::uint64_t>(st.st_size) < sizeof(bitfield_file_header))
+        {
+            ::close(fd);
+            return bitfield_file_status::not_a_bitfield_file;
+        }
+        void* const p = ::mmap(nullptr, static_cast<std::size_t>(st.st_size), cow ? PROT_READ | PROT_WRITE : PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (p == MAP_FAILED) return bitfield_file_status::cannot_map;
+        view = p;
+        view_size = static_cast<std::size_t>(st.st_size);
+    #endif
+        return bitfield_file_status::ok;
+    }
+
+public:
+    //--Constructors--
+    checked_bit_file() noexcept : view(nullptr), view_size(0), record_count(0), view_mode(bitfield_file_mode::read_only) {}
+    checked_bit_file(checked_bit_file&& rhs) noexcept : view(rhs.view), view_size(rhs.view_size), record_count(rhs.record_count), view_mode(rhs.view_mode)
+    {
+        rhs.view = nullptr;
+        rhs.view_size = rhs.record_count = 0;
+    }
+    checked_bit_file(const checked_bit_file&) = delete;
+    ~checked_bit_file() { close(); }
+
+    //--Copy Assignments--
+    checked_bit_file& operator=(checked_bit_file&& rhs) noexcept
+    {
+        if (this == &rhs) return *this;
+        close();
+        view = rhs.view;
+        view_size = rhs.view_size;
+        record_count = rhs.record_count;
+        view_mode = rhs.view_mode;
+        rhs.view = nullptr;
+        rhs.view_size = rhs.record_count = 0;
+        return *this;
+    }
+    checked_bit_file& operator=(const checked_bit_file&) = delete;
+
+    //--Mapping--
+    //maps path, closing any file mapped before. Nothing stays mapped unless ok is returned.
+    bitfield_file_status open(const char* path, const bitfield_file_mode mode = bitfield_file_mode::read_only) noexcept
+    {
+        close();
+        bitfield_file_status status = map(path, mode);
+        if (status != bitfield_file_status::ok) return status;
+        const bitfield_file_header& h = *static_cast<const bitfield_file_header*>(view);
+        status = check(h, view_size);
+        if (status != bitfield_file_status::ok)
+        {
+            close();
+            return status;
+        }
+        record_count = static_cast<std::size_t>(h.count);
+        view_mode = mode;
+        return bitfield_file_status::ok;
+    }
+    void close() noexcept
+    {
+        if (view == nullptr) return;
+    #if defined(_WIN32)
+        UnmapViewOfFile(view);
+    #else
+        ::munmap(view, view_size);
+    #endif
+        view = nullptr;
+        view_size = record_count = 0;
+    }
+    bool is_open() const noexcept { return view != nullptr; }
+    bitfield_file_mode mode() const noexcept { return view_mode; }
+
+    //--Records--
+    std::size_t size() const noexcept { return record_count; }
+    bool empty() const noexcept { return record_count == 0; }
+    const field_t* data() const noexcept { return is_open() ? traits::to_fields(words()) : nullptr; }
+    const field_t& operator[](const std::size_t i) const noexcept { assert(i < record_count); return data()[i]; }
+    const field_t* begin() const noexcept { return data(); }
+    const field_t* end() const noexcept { return data() + record_count; }
+    //the records of a copy_on_write mapping, writing through a read_only one faults
+    field_t* mutable_data() noexcept
+    {
+        assert(!is_open() || view_mode == bitfield_file_mode::copy_on_write);
+        return is_open() ? traits::to_fields(words()) : nullptr;
+    }
+
+    //--Saving--
+    //writes n records to path, replacing it. The records are written to path.tmp, flushed to the disk and then
+    //renamed over path, so a crash or a full disk leaves either the old file or the new one, never a part of one.
+    //A mapping of path must be closed first.
+    static bitfield_file_status save(const char* path, const field_t* records, const std::size_t n) noexcept
+    {
+        bitfield_file_header h = {};
+        std::memcpy(h.magic, bitfield_detail::file_magic, sizeof(h.magic));
+        h.version = bitfield_detail::file_version;
+        h.byte_order = bitfield_detail::file_byte_order;
+        h.word_size = sizeof(word_t);
+        h.type_hash = type_hash;
+        h.count = n;
+        const std::size_t length = std::strlen(path);
+        char* const temp = static_cast<char*>(std::malloc(length + sizeof(".tmp")));
+        if (temp == nullptr) return bitfield_file_status::cannot_open;
+        std::memcpy(temp, path, length);
+        std::memcpy(temp + length, ".tmp", sizeof(".tmp"));
+        std::FILE* const f = std::fopen(temp, "wb");
+        if (f == nullptr)
+        {
+            std::free(temp);
+            return bitfield_file_status::cannot_open;
+        }
+        bool written = std::fwrite(&h, sizeof(h), 1, f) == 1 && (n == 0 || std::fwrite(traits::to_words(records), sizeof(word_t), n, f) == n);
+        written = std::fflush(f) == 0 && written;
+    #if defined(_WIN32)
+        written = written && FlushFileBuffers(reinterpret_cast<HANDLE>(_get_osfhandle(_fileno(f))));
+        written = std::fclose(f) == 0 && written;
+        written = written && MoveFileExA(temp, path, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH);
+    #else
+        written = written && ::fsync(::fileno(f)) == 0;
+        written = std::fclose(f) == 0 && written;
+        written = written && std::rename(temp, path) == 0;
+    #endif
+        if (!written) std::remove(temp);
+        std::free(temp);
+        return written ? bitfield_file_status::ok : bitfield_file_status::cannot_open;
+    }
+};
+
+//mapped file type declaration for a BIT_FIELD - BIT_FILE(mybitfield, mybitfile, "myapp.mybitfield");
+//The type hash is taken from type_name, the identity of the records in the file, so a file is only opened by a
+//BIT_FILE with the same name. Pick a name that is unique to the program and the field, and keep it when the field
+//type is renamed or moved to another namespace.
+#define BIT_FILE( bitfield_t, bitfile_t, type_name ) typedef checked_bit_file<bitfield_t, bitfield_detail::fnv1a(type_name)> bitfile_t
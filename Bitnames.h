@@ -0,0 +1,240 @@
+/*Copyright 2017 Jonathan Campbell
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.*/
+//checked_bit_names - compile time table of the mask labels of a BIT_FIELD, to format fields as "READ|WRITE" and parse them back
+#pragma once
+#include "Bitfield.h"
+#include <optional>
+#include <string_view>
+
+namespace bitfield_detail
+{
+    //number of labels in the text of a BIT_NAMES mask list, "READ, WRITE" has two
+    constexpr std::size_t name_count(const char* list) noexcept
+    {
+        std::size_t n = *list != 0 ? 1 : 0;
+        for (; *list != 0; ++list) n += *list == ',' ? 1 : 0;
+        return n;
+    }
+    constexpr std::size_t ceil_pow2(const std::size_t n) noexcept
+    {
+        std::size_t p = 1;
+        while (p < n) p *= 2;
+        return p;
+    }
+    //seeded 64 bit FNV-1a with the high bits folded in, the hash of the name lookup
+    constexpr std::uint64_t name_hash(const std::string_view s, const std::uint64_t seed) noexcept
+    {
+        std::uint64_t h = 14695981039346656037ull ^ (seed * 0x9E3779B97F4A7C15ull);
+        for (const char c : s) h = (h ^ static_cast<unsigned char>(c)) * 1099511628211ull;
+        return h ^ (h >> 32);
+    }
+    //not constexpr, so a BIT_NAMES table with the same label twice fails to compile here
+    inline void bit_names_label_repeated() noexcept {}
+}
+
+//The labels and masks of a BIT_FIELD, in the order they are listed, built at compile time by BIT_NAMES.
+//format_to writes a field as the labels of its masks joined by '|' into a caller buffer, parse reads that
+//text back through a perfect hash of the labels. Neither allocates.
+//A mask is written when all of its bits are set and not yet written, so list multi bit masks
+//before the single bits to prefer them. Bits no mask covers are written as one hex number,
+//and a field with no bits set as "0". parse accepts the same, with spaces around the labels.
+template <typename field_type, std::size_t N>
+class checked_bit_names
+{
+public:
+    typedef bitfield_traits<field_type> traits;
+    typedef typename traits::word_t word_t;
+    typedef typename traits::field_t field_t;
+    typedef typename traits::fieldbit_t fieldbit_t;
+    static_assert(N > 0, "BIT_NAMES needs at least one mask");
+    static_assert(N < 65535, "too many masks");
+
+private:
+    typedef typename std::make_unsigned<word_t>::type uword_t;
+    static constexpr std::size_t hex_digits = 2 * sizeof(word_t);
+    //the lookup hashes a label to a bucket, then with the bucket's seed to a slot holding its entry.
+    //Seeds are chosen when the table is built so that no two labels share a slot.
+    static constexpr std::size_t bucket_count = bitfield_detail::ceil_pow2(N);
+    static constexpr std::size_t slot_count = 2 * bucket_count;
+
+    uword_t masks[N] = {};
+    std::string_view labels[N] = {};
+    std::uint64_t seeds[bucket_count] = {};
+    std::uint16_t slots[slot_count] = {};   //entry + 1, 0 if empty
+    std::size_t longest = 0;
+
+    static constexpr std::size_t bucket(const std::string_view s) noexcept { return static_cast<std::size_t>(bitfield_detail::name_hash(s, 0)) & (bucket_count - 1); }
+    static constexpr std::size_t slot(const std::string_view s, const std::uint64_t seed) noexcept { return static_cast<std::size_t>(bitfield_detail::name_hash(s, seed)) & (slot_count - 1); }
+
+    //finds a seed for each bucket, the fullest buckets first while the slots are emptiest
+    constexpr void place() noexcept
+    {
+        std::size_t sizes[bucket_count] = {};
+        for (std::size_t i = 0; i < N; ++i) ++sizes[bucket(labels[i])];
+        for (std::size_t size = N; size > 0; --size)
+            for (std::size_t b = 0; b < bucket_count; ++b)
+            {
+                if (sizes[b] != size) continue;
+                for (std::uint64_t seed = 1;; ++seed)
+                {
+                    if (seed > 4 * slot_count * slot_count)
+                    {
+                        //only labels that are equal hash alike for every seed
+                        bitfield_detail::bit_names_label_repeated();
+                        return;
+                    }
+                    bool placed = true;
+                    std::size_t i = 0;
+                    for (; i < N && placed; ++i)
+                    {
+                        if (bucket(labels[i]) != b) continue;
+                        std::uint16_t& s = slots[slot(labels[i], seed)];
+                        if (s != 0) placed = false;
+                        else s = static_cast<std::uint16_t>(i + 1);
+                    }
+                    if (placed)
+                    {
+                        seeds[b] = seed;
+                        break;
+                    }
+                    //undo the labels placed with this seed, they are the ones before i that hold their own slot
+                    for (std::size_t j = 0; j + 1 < i; ++j)
+                        if (bucket(labels[j]) == b && slots[slot(labels[j], seed)] == j + 1) slots[slot(labels[j], seed)] = 0;
+                }
+            }
+    }
+
+    //entry of label s, N if there is none
+    constexpr std::size_t find(const std::string_view s) const noexcept
+    {
+        const std::size_t e = slots[slot(s, seeds[bucket(s)])];
+        return e != 0 && labels[e - 1] == s ? e - 1 : N;
+    }
+
+    static constexpr bool is_space(const char c) noexcept { return c == ' ' || c == '\t'; }
+    static constexpr int hex_value(const char c) noexcept
+    {
+        return c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10 : c >= 'A' && c <= 'F' ? c - 'A' + 10 : -1;
+    }
+
+public:
+    //--Constructors--
+    //list is the text of the mask list, "READ, WRITE", masks their values in the same order. A label is the
+    //last part of a qualified name, so perm::READ is READ. Use BIT_NAMES rather than calling this directly.
+    constexpr checked_bit_names(const char* list, const fieldbit_t (&m)[N]) noexcept
+    {
+        for (std::size_t i = 0; i < N; ++i)
+        {
+            while (is_space(*list)) ++list;
+            const char* first = list;
+            for (; *list != 0 && *list != ',' && !is_space(*list); ++list)
+                if (*list == ':') first = list + 1;
+            labels[i] = std::string_view(first, static_cast<std::size_t>(list - first));
+            while (*list != 0 && *list != ',') ++list;
+            if (*list == ',') ++list;
+            masks[i] = static_cast<uword_t>(traits::to_word(m[i]));
+            longest += labels[i].size() + 1;
+        }
+        longest += 2 + hex_digits;
+        place();
+    }
+
+    //--Table--
+    static constexpr std::size_t size() noexcept { return N; }
+    constexpr std::string_view label(const std::size_t i) const noexcept { return labels[i]; }
+    constexpr fieldbit_t mask(const std::size_t i) const noexcept { return traits::to_fieldbit(static_cast<word_t>(masks[i])); }
+    //bit of a single bit mask numbered from 1 as in set_bit, 0 for a mask of none or several bits
+    constexpr unsigned int position(const std::size_t i) const noexcept { return (masks[i] & (masks[i] - 1)) == 0 ? bitfield_detail::first_set(masks[i]) : 0; }
+    //label of the mask equal to m, empty if none. Not an overload of label, masks are integers in the plain build.
+    constexpr std::string_view label_of(const fieldbit_t& m) const noexcept
+    {
+        for (std::size_t i = 0; i < N; ++i)
+            if (masks[i] == static_cast<uword_t>(traits::to_word(m))) return labels[i];
+        return std::string_view();
+    }
+
+    //--Formatting--
+    //most characters format_to writes, a buffer of this size holds any field
+    constexpr std::size_t max_length() const noexcept { return longest; }
+    //writes f to out, at most max_length() characters with no terminating 0, and returns the end of the text
+    constexpr char* format_to(char* out, const field_t& f) const noexcept
+    {
+        uword_t rest = static_cast<uword_t>(traits::to_word(f));
+        if (rest == 0)
+        {
+            *out++ = '0';
+            return out;
+        }
+        bool first = true;
+        for (std::size_t i = 0; i < N && rest != 0; ++i)
+        {
+            if (masks[i] == 0 || (rest & masks[i]) != masks[i]) continue;
+            if (!first) *out++ = '|';
+            for (const char c : labels[i]) *out++ = c;
+            rest = static_cast<uword_t>(rest & ~masks[i]);
+            first = false;
+        }
+        if (rest != 0)
+        {
+            if (!first) *out++ = '|';
+            *out++ = '0';
+            *out++ = 'x';
+            std::size_t digits = 1;
+            while (digits < hex_digits && (rest >> (4 * digits)) != 0) ++digits;
+            while (digits-- > 0) *out++ = "0123456789ABCDEF"[(rest >> (4 * digits)) & 0xF];
+        }
+        return out;
+    }
+
+    //--Parsing--
+    //the field written as text by format_to, nothing if a label is unknown or the text is malformed
+    constexpr std::optional<field_t> parse(const std::string_view text) const noexcept
+    {
+        uword_t w = 0;
+        std::size_t pos = 0;
+        for (;;)
+        {
+            std::size_t end = pos;
+            while (end < text.size() && text[end] != '|') ++end;
+            std::size_t first = pos, last = end;
+            while (first < last && is_space(text[first])) ++first;
+            while (last > first && is_space(text[last - 1])) --last;
+            const std::string_view token = text.substr(first, last - first);
+            if (token.empty()) return std::nullopt;
+            if (token.size() > 2 && token[0] == '0' && (token[1] == 'x' || token[1] == 'X'))
+            {
+                uword_t v = 0;
+                for (std::size_t i = 2; i < token.size(); ++i)
+                {
+                    const int d = hex_value(token[i]);
+                    if (d < 0 || (v >> (8 * sizeof(uword_t) - 4)) != 0) return std::nullopt;
+                    v = static_cast<uword_t>((v << 4) | static_cast<uword_t>(d));
+                }
+                w |= v;
+            }
+            else if (token != "0")
+            {
+                const std::size_t e = find(token);
+                if (e == N) return std::nullopt;
+                w |= masks[e];
+            }
+            if (end == text.size()) return traits::to_field(static_cast<word_t>(w));
+            pos = end + 1;
+        }
+    }
+};
+
+//label table declaration for masks of a BIT_FIELD - BIT_NAMES(mybitfield, mynames, mask1, mask2);
+//The masks must be constant, as BIT_MASK and INT_BIT_MASK declare them. Their labels are taken from the list.
+#define BIT_NAMES( bitfield_t, table, ... ) static constexpr checked_bit_names<bitfield_t, bitfield_detail::name_count(#__VA_ARGS__)> table{ #__VA_ARGS__, { __VA_ARGS__ } }
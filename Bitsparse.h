@@ -0,0 +1,597 @@
+/*Copyright 2017 Jonathan Campbell
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.*/
+//checked_sparse_bit_vector - compressed counterpart of checked_bit_vector for sparse bits over a 32 bit index space
+#pragma once
+#include "Bitvector.h"
+#include <algorithm>
+#include <vector>
+
+namespace bitfield_detail
+{
+    //65536 bits of a sparse vector, those whose index has the same upper 16 bits. The chunk is stored in
+    //whichever of three forms fits it - a sorted array of the set bits, a plain bitset or a list of runs.
+    struct sparse_chunk
+    {
+        enum kind_t : std::uint8_t { array, bitset, run };
+        typedef std::vector<std::uint64_t, bitfield_aligned_allocator<std::uint64_t>> bitset_t;
+        //an array chunk holds at most this many bits, past it the 8KB bitset is smaller
+        static constexpr std::uint32_t array_max = 4096;
+        static constexpr std::size_t bitset_words = 65536 / 64;
+
+        kind_t kind = array;
+        std::uint32_t card = 0;
+        std::vector<std::uint16_t> values;  //array - the set bits in order, run - first and last bit of each run
+        bitset_t bits;                      //bitset - bitset_words words
+
+        std::size_t runs() const noexcept { return values.size() / 2; }
+        std::size_t memory_usage() const noexcept { return values.capacity() * sizeof(std::uint16_t) + bits.capacity() * sizeof(std::uint64_t); }
+
+        bool test(const std::uint16_t v) const noexcept
+        {
+            switch (kind)
+            {
+            case array: return std::binary_search(values.begin(), values.end(), v);
+            case bitset: return (bits[v / 64] >> (v % 64)) & 1;
+            default:
+            {
+                //the last run starting at or before v
+                std::size_t lo = 0, hi = runs();
+                while (lo < hi)
+                {
+                    const std::size_t mid = (lo + hi) / 2;
+                    if (values[2 * mid] <= v) lo = mid + 1; else hi = mid;
+                }
+                return lo != 0 && v <= values[2 * lo - 1];
+            }
+            }
+        }
+
+        //calls fn(v) for each set bit in order
+        template <typename function_t>
+        void each(function_t fn) const
+        {
+            switch (kind)
+            {
+            case array: for (const std::uint16_t v : values) fn(v); break;
+            case bitset:
+                for (std::size_t w = 0; w < bitset_words; ++w)
+                    for (std::uint64_t rest = bits[w]; rest != 0; rest &= rest - 1)
+                        fn(static_cast<std::uint16_t>(w * 64 + countr_zero(rest)));
+                break;
+            default:
+                for (std::size_t r = 0; r < runs(); ++r)
+                    for (std::uint32_t v = values[2 * r]; v <= values[2 * r + 1]; ++v) fn(static_cast<std::uint16_t>(v));
+            }
+        }
+
+        //writes the chunk as a bitset of bitset_words words to out
+        void to_bits(std::uint64_t* out) const noexcept
+        {
+            if (kind == bitset)
+            {
+                std::copy(bits.begin(), bits.end(), out);
+                return;
+            }
+            std::fill(out, out + bitset_words, std::uint64_t(0));
+            if (kind == array)
+                for (const std::uint16_t v : values) out[v / 64] |= std::uint64_t(1) << (v % 64);
+            else
+                for (std::size_t r = 0; r < runs(); ++r) fill_bits(out, values[2 * r], values[2 * r + 1]);
+        }
+        //the words of the chunk as a bitset, written to scratch unless the chunk is one
+        const std::uint64_t* as_bits(std::uint64_t* scratch) const noexcept
+        {
+            if (kind == bitset) return bits.data();
+            to_bits(scratch);
+            return scratch;
+        }
+        //sets bits [first, last] of a bitset
+        static void fill_bits(std::uint64_t* out, const std::uint32_t first, const std::uint32_t last) noexcept
+        {
+            const std::size_t first_word = first / 64, last_word = last / 64;
+            const std::uint64_t head = ~std::uint64_t(0) << (first % 64), tail = ~std::uint64_t(0) >> (63 - last % 64);
+            if (first_word == last_word)
+            {
+                out[first_word] |= head & tail;
+                return;
+            }
+            out[first_word] |= head;
+            for (std::size_t w = first_word + 1; w < last_word; ++w) out[w] = ~std::uint64_t(0);
+            out[last_word] |= tail;
+        }
+        static std::uint32_t count_bits(const std::uint64_t* b) noexcept
+        {
+            std::uint32_t n = 0;
+            for (std::size_t w = 0; w < bitset_words; ++w) n += popcount(b[w]);
+            return n;
+        }
+
+        //--Conversions--
+        void make_array()
+        {
+            std::vector<std::uint16_t> a;
+            a.reserve(card);
+            each([&a](const std::uint16_t v) { a.push_back(v); });
+            values.swap(a);
+            bits = bitset_t();
+            kind = array;
+        }
+        void make_bitset()
+        {
+            if (kind == bitset) return;
+            bitset_t b(bitset_words);
+            to_bits(b.data());
+            bits.swap(b);
+            values = std::vector<std::uint16_t>();
+            kind = bitset;
+        }
+        void make_run()
+        {
+            std::vector<std::uint16_t> r;
+            r.reserve(2 * count_runs());
+            each([&r](const std::uint16_t v)
+            {
+                if (!r.empty() && r.back() + 1u == v) r.back() = v;
+                else { r.push_back(v); r.push_back(v); }
+            });
+            values.swap(r);
+            bits = bitset_t();
+            kind = run;
+        }
+        //before a single bit change - a run chunk becomes an array or a bitset
+        void unrun()
+        {
+            if (kind == run) { if (card <= array_max) make_array(); else make_bitset(); }
+        }
+        //after a change - an array grown past array_max becomes a bitset, a bitset shrunk to it an array
+        void settle()
+        {
+            if (kind == array && card > array_max) make_bitset();
+            else if (kind == bitset && card <= array_max) make_array();
+        }
+        std::size_t count_runs() const noexcept
+        {
+            switch (kind)
+            {
+            case run: return runs();
+            case array:
+            {
+                std::size_t n = 0;
+                for (std::size_t i = 0; i < values.size(); ++i) n += i == 0 || values[i] != values[i - 1] + 1u;
+                return n;
+            }
+            default:
+            {
+                //a run starts at every set bit whose lower neighbour is clear
+                std::size_t n = 0;
+                std::uint64_t carry = 0;
+                for (std::size_t w = 0; w < bitset_words; ++w)
+                {
+                    n += popcount(bits[w] & ~((bits[w] << 1) | carry));
+                    carry = bits[w] >> 63;
+                }
+                return n;
+            }
+            }
+        }
+        //picks the smallest of the three forms
+        void optimize()
+        {
+            const std::size_t run_bytes = 4 * count_runs(), array_bytes = 2 * std::size_t(card), bitset_bytes = 8 * bitset_words;
+            if (run_bytes < std::min(array_bytes, bitset_bytes)) { if (kind != run) make_run(); }
+            else if (card <= array_max) { if (kind != array) make_array(); }
+            else make_bitset();
+        }
+
+        //--Set operations--
+        //a chunk from a bitset result, counted and settled
+        static sparse_chunk from_bits(bitset_t&& b)
+        {
+            sparse_chunk c;
+            c.kind = bitset;
+            c.card = count_bits(b.data());
+            c.bits.swap(b);
+            c.settle();
+            return c;
+        }
+        static sparse_chunk and_of(const sparse_chunk& a, const sparse_chunk& b)
+        {
+            sparse_chunk c;
+            if (a.kind == array && b.kind == array)
+                std::set_intersection(a.values.begin(), a.values.end(), b.values.begin(), b.values.end(), std::back_inserter(c.values));
+            else if (a.kind == array || b.kind == array)
+            {
+                const sparse_chunk& x = a.kind == array ? a : b;
+                const sparse_chunk& y = a.kind == array ? b : a;
+                for (const std::uint16_t v : x.values)
+                    if (y.test(v)) c.values.push_back(v);
+            }
+            else
+            {
+                bitset_t scratch_a(a.kind == bitset ? 0 : bitset_words), scratch_b(b.kind == bitset ? 0 : bitset_words), r(bitset_words);
+                wide_apply<op_and>(r.data(), a.as_bits(scratch_a.data()), b.as_bits(scratch_b.data()), bitset_words);
+                return from_bits(std::move(r));
+            }
+            c.card = static_cast<std::uint32_t>(c.values.size());
+            return c;
+        }
+        static sparse_chunk or_of(const sparse_chunk& a, const sparse_chunk& b)
+        {
+            if (a.kind == array && b.kind == array)
+            {
+                sparse_chunk c;
+                c.values.reserve(a.values.size() + b.values.size());
+                std::set_union(a.values.begin(), a.values.end(), b.values.begin(), b.values.end(), std::back_inserter(c.values));
+                c.card = static_cast<std::uint32_t>(c.values.size());
+                c.settle();
+                return c;
+            }
+            //the array side, if any, is set bit by bit into the other as a bitset
+            const sparse_chunk& x = b.kind == array ? b : a;
+            const sparse_chunk& y = b.kind == array ? a : b;
+            bitset_t r(bitset_words);
+            y.to_bits(r.data());
+            if (x.kind == array)
+                for (const std::uint16_t v : x.values) r[v / 64] |= std::uint64_t(1) << (v % 64);
+            else
+            {
+                bitset_t scratch(x.kind == bitset ? 0 : bitset_words);
+                wide_apply<op_or>(r.data(), r.data(), x.as_bits(scratch.data()), bitset_words);
+            }
+            return from_bits(std::move(r));
+        }
+        static sparse_chunk and_not_of(const sparse_chunk& a, const sparse_chunk& b)
+        {
+            if (a.kind == array)
+            {
+                sparse_chunk c;
+                for (const std::uint16_t v : a.values)
+                    if (!b.test(v)) c.values.push_back(v);
+                c.card = static_cast<std::uint32_t>(c.values.size());
+                return c;
+            }
+            bitset_t r(bitset_words);
+            a.to_bits(r.data());
+            if (b.kind == array)
+                for (const std::uint16_t v : b.values) r[v / 64] &= ~(std::uint64_t(1) << (v % 64));
+            else
+            {
+                bitset_t scratch(b.kind == bitset ? 0 : bitset_words);
+                wide_apply<op_andnot>(r.data(), r.data(), b.as_bits(scratch.data()), bitset_words);
+            }
+            return from_bits(std::move(r));
+        }
+        static bool equal(const sparse_chunk& a, const sparse_chunk& b)
+        {
+            if (a.card != b.card) return false;
+            if (a.kind == b.kind) return a.kind == bitset ? a.bits == b.bits : a.values == b.values;
+            bitset_t scratch_a(bitset_words), scratch_b(bitset_words);
+            a.to_bits(scratch_a.data());
+            b.to_bits(scratch_b.data());
+            return scratch_a == scratch_b;
+        }
+    };
+}
+
+//A set of 32 bit indices stored in 65536 bit chunks, each an array, a bitset or a list of runs, so memory
+//follows the number of set bits and runs rather than the highest index. Chunks with no bits aren't stored.
+//set/clear keep every chunk an array or a bitset, optimize turns chunks into runs where that is smaller.
+//The unique_id keeps vectors of different domains apart, declare them through SPARSE_BIT_VECTOR.
+template <bitfield_unique_id* unique_id>
+class checked_sparse_bit_vector
+{
+    typedef bitfield_detail::sparse_chunk chunk_t;
+
+    std::vector<std::uint16_t> keys;    //upper 16 bits of the indices of each chunk, in order
+    std::vector<chunk_t> chunks;
+
+    static std::uint16_t key_of(const std::uint32_t pos) noexcept { return static_cast<std::uint16_t>(pos >> 16); }
+    static std::uint16_t low_of(const std::uint32_t pos) noexcept { return static_cast<std::uint16_t>(pos); }
+    //index of the chunk for key, or of where it would be inserted
+    std::size_t find_chunk(const std::uint16_t key) const noexcept { return static_cast<std::size_t>(std::lower_bound(keys.begin(), keys.end(), key) - keys.begin()); }
+    bool has_chunk(const std::size_t i, const std::uint16_t key) const noexcept { return i < keys.size() && keys[i] == key; }
+    void erase_chunk(const std::size_t i)
+    {
+        keys.erase(keys.begin() + static_cast<std::ptrdiff_t>(i));
+        chunks.erase(chunks.begin() + static_cast<std::ptrdiff_t>(i));
+    }
+
+public:
+    class const_iterator
+    {
+        const checked_sparse_bit_vector* owner;
+        std::size_t chunk;      //chunk of the current bit, chunks.size() at the end
+        std::size_t slot;       //array - index of the bit, run - index of the run
+        std::uint32_t low;      //lower 16 bits of the current bit
+
+        const chunk_t& current() const noexcept { return owner->chunks[chunk]; }
+        //first set bit of the bitset chunk at or after from, false if there is none
+        bool seek_bit(const std::size_t from) noexcept
+        {
+            if (from >= 65536) return false;
+            const std::uint64_t* bits = current().bits.data();
+            std::size_t w = from / 64;
+            const std::uint64_t first = bits[w] & (~std::uint64_t(0) << (from % 64));
+            if (first == 0)
+            {
+                w = bitfield_detail::find_nonzero_word(bits, w + 1, chunk_t::bitset_words);
+                if (w == chunk_t::bitset_words) return false;
+                low = static_cast<std::uint32_t>(w * 64 + bitfield_detail::countr_zero(bits[w]));
+            }
+            else low = static_cast<std::uint32_t>(w * 64 + bitfield_detail::countr_zero(first));
+            return true;
+        }
+        void enter_chunk() noexcept
+        {
+            slot = 0;
+            if (chunk == owner->chunks.size()) return;
+            if (current().kind == chunk_t::bitset) seek_bit(0);
+            else low = current().values[0];
+        }
+
+    public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef std::uint32_t value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const std::uint32_t* pointer;
+        typedef std::uint32_t reference;
+
+        const_iterator() noexcept : owner(nullptr), chunk(0), slot(0), low(0) {}
+        const_iterator(const checked_sparse_bit_vector* v, const std::size_t c) noexcept : owner(v), chunk(c), slot(0), low(0) { enter_chunk(); }
+
+        std::uint32_t operator*() const noexcept { return std::uint32_t(owner->keys[chunk]) << 16 | low; }
+        const_iterator& operator++() noexcept
+        {
+            const chunk_t& c = current();
+            bool more;
+            switch (c.kind)
+            {
+            case chunk_t::array:
+                more = ++slot < c.values.size();
+                if (more) low = c.values[slot];
+                break;
+            case chunk_t::bitset:
+                more = seek_bit(std::size_t(low) + 1);
+                break;
+            default:
+                if (low < c.values[2 * slot + 1]) { ++low; more = true; }
+                else
+                {
+                    more = ++slot < c.runs();
+                    if (more) low = c.values[2 * slot];
+                }
+            }
+            if (!more)
+            {
+                ++chunk;
+                enter_chunk();
+            }
+            return *this;
+        }
+        const_iterator operator++(int) noexcept { const_iterator t = *this; ++*this; return t; }
+        bool operator==(const const_iterator& rhs) const noexcept { return chunk == rhs.chunk && (chunk == owner->chunks.size() || low == rhs.low); }
+        bool operator!=(const const_iterator& rhs) const noexcept { return !(*this == rhs); }
+    };
+    typedef const_iterator iterator;
+
+    //--Constructors--
+    checked_sparse_bit_vector() noexcept {}
+
+    //--Size--
+    //number of set bits
+    std::size_t count() const noexcept
+    {
+        std::size_t n = 0;
+        for (const chunk_t& c : chunks) n += c.card;
+        return n;
+    }
+    bool any() const noexcept { return !chunks.empty(); }
+    bool none() const noexcept { return chunks.empty(); }
+    //bytes allocated by the vector, the object itself included
+    std::size_t memory_usage() const noexcept
+    {
+        std::size_t n = sizeof(*this) + keys.capacity() * sizeof(std::uint16_t) + chunks.capacity() * sizeof(chunk_t);
+        for (const chunk_t& c : chunks) n += c.memory_usage();
+        return n;
+    }
+
+    //--Single bits--
+    bool test(const std::uint32_t pos) const noexcept
+    {
+        const std::size_t i = find_chunk(key_of(pos));
+        return has_chunk(i, key_of(pos)) && chunks[i].test(low_of(pos));
+    }
+    bool operator[](const std::uint32_t pos) const noexcept { return test(pos); }
+    void set(const std::uint32_t pos)
+    {
+        const std::size_t i = find_chunk(key_of(pos));
+        if (!has_chunk(i, key_of(pos)))
+        {
+            keys.insert(keys.begin() + static_cast<std::ptrdiff_t>(i), key_of(pos));
+            chunks.insert(chunks.begin() + static_cast<std::ptrdiff_t>(i), chunk_t());
+        }
+        chunk_t& c = chunks[i];
+        c.unrun();
+        const std::uint16_t v = low_of(pos);
+        if (c.kind == chunk_t::array)
+        {
+            const auto at = std::lower_bound(c.values.begin(), c.values.end(), v);
+            if (at != c.values.end() && *at == v) return;
+            c.values.insert(at, v);
+        }
+        else
+        {
+            std::uint64_t& w = c.bits[v / 64];
+            if ((w >> (v % 64)) & 1) return;
+            w |= std::uint64_t(1) << (v % 64);
+        }
+        ++c.card;
+        c.settle();
+    }
+    void clear(const std::uint32_t pos)
+    {
+        const std::size_t i = find_chunk(key_of(pos));
+        if (!has_chunk(i, key_of(pos)) || !chunks[i].test(low_of(pos))) return;
+        chunk_t& c = chunks[i];
+        if (c.card == 1)
+        {
+            erase_chunk(i);
+            return;
+        }
+        c.unrun();
+        const std::uint16_t v = low_of(pos);
+        if (c.kind == chunk_t::array) c.values.erase(std::lower_bound(c.values.begin(), c.values.end(), v));
+        else c.bits[v / 64] &= ~(std::uint64_t(1) << (v % 64));
+        --c.card;
+        c.settle();
+    }
+
+    //--Bulk operations--
+    //sets the bits [first, last), last may be 2^32. Chunks that the range covers completely become single runs.
+    void set_range(const std::uint64_t first, const std::uint64_t last)
+    {
+        assert(first <= last && last <= (std::uint64_t(1) << 32));
+        for (std::uint64_t lo = first; lo < last;)
+        {
+            const std::uint16_t key = static_cast<std::uint16_t>(lo >> 16);
+            const std::uint64_t hi = std::min(last, (std::uint64_t(key) + 1) << 16);
+            const std::uint16_t a = static_cast<std::uint16_t>(lo), b = static_cast<std::uint16_t>(hi - 1);
+            const std::size_t i = find_chunk(key);
+            if (!has_chunk(i, key) || std::uint32_t(b - a) + 1 == 65536)
+            {
+                chunk_t c;
+                c.kind = chunk_t::run;
+                c.values = { a, b };
+                c.card = std::uint32_t(b - a) + 1;
+                if (has_chunk(i, key)) chunks[i] = std::move(c);
+                else
+                {
+                    keys.insert(keys.begin() + static_cast<std::ptrdiff_t>(i), key);
+                    chunks.insert(chunks.begin() + static_cast<std::ptrdiff_t>(i), std::move(c));
+                }
+            }
+            else
+            {
+                chunk_t& c = chunks[i];
+                c.make_bitset();
+                chunk_t::fill_bits(c.bits.data(), a, b);
+                c.card = chunk_t::count_bits(c.bits.data());
+                c.optimize();
+            }
+            lo = hi;
+        }
+    }
+    void clear_all() noexcept
+    {
+        keys.clear();
+        chunks.clear();
+    }
+    //keeps the bits also set in rhs
+    void and_with(const checked_sparse_bit_vector& rhs)
+    {
+        std::size_t out = 0;
+        for (std::size_t i = 0, j = 0; i < keys.size() && j < rhs.keys.size();)
+        {
+            if (keys[i] < rhs.keys[j]) ++i;
+            else if (keys[i] > rhs.keys[j]) ++j;
+            else
+            {
+                chunk_t c = chunk_t::and_of(chunks[i], rhs.chunks[j]);
+                if (c.card != 0)
+                {
+                    keys[out] = keys[i];
+                    chunks[out++] = std::move(c);
+                }
+                ++i, ++j;
+            }
+        }
+        keys.resize(out);
+        chunks.resize(out);
+    }
+    //adds the bits set in rhs
+    void or_with(const checked_sparse_bit_vector& rhs)
+    {
+        std::vector<std::uint16_t> k;
+        std::vector<chunk_t> c;
+        k.reserve(keys.size() + rhs.keys.size());
+        c.reserve(keys.size() + rhs.keys.size());
+        std::size_t i = 0, j = 0;
+        while (i < keys.size() || j < rhs.keys.size())
+        {
+            if (j == rhs.keys.size() || (i < keys.size() && keys[i] < rhs.keys[j]))
+            {
+                k.push_back(keys[i]);
+                c.push_back(std::move(chunks[i++]));
+            }
+            else if (i == keys.size() || keys[i] > rhs.keys[j])
+            {
+                k.push_back(rhs.keys[j]);
+                c.push_back(rhs.chunks[j++]);
+            }
+            else
+            {
+                k.push_back(keys[i]);
+                c.push_back(chunk_t::or_of(chunks[i++], rhs.chunks[j++]));
+            }
+        }
+        keys.swap(k);
+        chunks.swap(c);
+    }
+    //clears the bits set in rhs
+    void and_not_with(const checked_sparse_bit_vector& rhs)
+    {
+        std::size_t out = 0;
+        for (std::size_t i = 0, j = 0; i < keys.size(); ++i)
+        {
+            while (j < rhs.keys.size() && rhs.keys[j] < keys[i]) ++j;
+            chunk_t c = j < rhs.keys.size() && rhs.keys[j] == keys[i] ? chunk_t::and_not_of(chunks[i], rhs.chunks[j]) : std::move(chunks[i]);
+            if (c.card != 0)
+            {
+                keys[out] = keys[i];
+                chunks[out++] = std::move(c);
+            }
+        }
+        keys.resize(out);
+        chunks.resize(out);
+    }
+    //stores every chunk in its smallest form, runs included. Worth calling once a vector is built.
+    void optimize()
+    {
+        for (chunk_t& c : chunks) c.optimize();
+    }
+
+    //--Queries--
+    //index of the lowest set bit, some bit must be set
+    std::uint32_t find_first() const noexcept { assert(any()); return *begin(); }
+    const_iterator begin() const noexcept { return const_iterator(this, 0); }
+    const_iterator end() const noexcept { return const_iterator(this, chunks.size()); }
+
+    bool operator==(const checked_sparse_bit_vector& rhs) const
+    {
+        if (keys != rhs.keys) return false;
+        for (std::size_t i = 0; i < chunks.size(); ++i)
+            if (!chunk_t::equal(chunks[i], rhs.chunks[i])) return false;
+        return true;
+    }
+    bool operator!=(const checked_sparse_bit_vector& rhs) const { return !(*this == rhs); }
+
+    void swap(checked_sparse_bit_vector& rhs) noexcept
+    {
+        keys.swap(rhs.keys);
+        chunks.swap(rhs.chunks);
+    }
+};
+
+//sparse bit vector type declaration sharing the unique id of a BIT_FIELD - SPARSE_BIT_VECTOR(mybitfield, mysparsevector);
+#define SPARSE_BIT_VECTOR( bitfield_t, bitvector_t ) typedef checked_sparse_bit_vector<bitfield_traits<bitfield_t>::unique_id> bitvector_t
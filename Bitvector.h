@@ -0,0 +1,313 @@
+/*Copyright 2017 Jonathan Campbell
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.*/
+//checked_bit_vector - resizable bulk storage counterpart of checked_bit_field, one bit per entry
+#pragma once
+#include "Bitfield.h"
+#include <algorithm>
+#include <memory>
+#include <new>
+
+//allocator handing out storage aligned to "alignment" bytes, the default for checked_bit_vector so that
+//every word block starts on a cache line
+template <typename T, std::size_t alignment = 64>
+struct bitfield_aligned_allocator
+{
+    static_assert(alignment >= alignof(T) && (alignment & (alignment - 1)) == 0, "alignment must be a power of two");
+    typedef T value_type;
+    template <typename U> struct rebind { typedef bitfield_aligned_allocator<U, alignment> other; };
+
+    bitfield_aligned_allocator() noexcept {}
+    template <typename U> bitfield_aligned_allocator(const bitfield_aligned_allocator<U, alignment>&) noexcept {}
+
+    T* allocate(const std::size_t n) { return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t(alignment))); }
+    void deallocate(T* p, std::size_t) noexcept { ::operator delete(p, std::align_val_t(alignment)); }
+
+    template <typename U> bool operator==(const bitfield_aligned_allocator<U, alignment>&) const noexcept { return true; }
+    template <typename U> bool operator!=(const bitfield_aligned_allocator<U, alignment>&) const noexcept { return false; }
+};
+
+namespace bitfield_detail
+{
+    //index of the first non-zero word in [from, n), n if there is none. Whole zero vectors are skipped at a time.
+    template <typename word_t>
+    inline std::size_t find_nonzero_word(const word_t* a, std::size_t from, const std::size_t n) noexcept
+    {
+    #ifdef BITFIELD_AVX2
+        for (constexpr std::size_t step = 32 / sizeof(word_t); from + step <= n; from += step)
+        {
+            const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + from));
+            if (!_mm256_testz_si256(v, v)) break;
+        }
+    #elif defined(BITFIELD_SSE2)
+        for (constexpr std::size_t step = 16 / sizeof(word_t); from + step <= n; from += step)
+        {
+            const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + from));
+            if (_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_setzero_si128())) != 0xFFFF) break;
+        }
+    #endif
+        while (from < n && a[from] == 0) ++from;
+        return from;
+    }
+}
+
+//bits are addressed by index from 0, as in std::vector<bool>. The unique_id keeps vectors of different
+//domains apart, declare them through BIT_VECTOR. allocator_t must allocate std::uint64_t, storage is
+//expected to be 64 byte aligned when an arena allocator is plugged in.
+template <bitfield_unique_id* unique_id, typename allocator_t = bitfield_aligned_allocator<std::uint64_t>>
+class checked_bit_vector
+{
+public:
+    typedef std::uint64_t word_t;
+    typedef allocator_t allocator_type;
+    static_assert(std::is_same<typename std::allocator_traits<allocator_t>::value_type, word_t>::value, "allocator must allocate std::uint64_t");
+    static constexpr std::size_t word_bits = 64;
+    //returned by find_first/find_next when no bit is found
+    static constexpr std::size_t npos = static_cast<std::size_t>(-1);
+
+private:
+    typedef std::allocator_traits<allocator_t> alloc_traits;
+    //words are allocated in whole cache lines so the kernels never need a partial vector
+    static constexpr std::size_t line_words = 64 / sizeof(word_t);
+
+    allocator_t alloc;
+    word_t* words;
+    std::size_t bit_count;
+    std::size_t word_capacity;
+
+    static constexpr std::size_t words_for(const std::size_t bits) noexcept { return (bits + word_bits - 1) / word_bits; }
+    static constexpr std::size_t lines_for(const std::size_t bits) noexcept { return (words_for(bits) + line_words - 1) / line_words * line_words; }
+    std::size_t word_count() const noexcept { return words_for(bit_count); }
+    //number of bits of an expression over vectors, from its word count and the valid bits of its last word
+    template <typename node_t>
+    static std::size_t expr_bits(const node_t& e) noexcept { return e.size() == 0 ? 0 : e.size() * word_bits - bitfield_detail::countl_zero(e.last_mask()); }
+    //the expression node of an operand, which must be the size of this vector
+    template <typename rhs_t>
+    auto checked_operand(const rhs_t& rhs) const noexcept -> decltype(rhs.expr_node())
+    {
+        assert(expr_bits(rhs.expr_node()) == bit_count);
+        return rhs.expr_node();
+    }
+
+    //clears the bits of the last word above size(), they must stay zero for count and the comparisons
+    void trim() noexcept
+    {
+        if (bit_count % word_bits != 0) words[bit_count / word_bits] &= (word_t(1) << (bit_count % word_bits)) - 1;
+    }
+    void release() noexcept
+    {
+        if (words != nullptr) alloc_traits::deallocate(alloc, words, word_capacity);
+        words = nullptr;
+        word_capacity = 0;
+    }
+    //sets bits [first, last) of the words to value
+    void fill(const std::size_t first, const std::size_t last, const bool value) noexcept
+    {
+        if (first >= last) return;
+        const std::size_t first_word = first / word_bits, last_word = (last - 1) / word_bits;
+        const word_t head = ~word_t(0) << (first % word_bits);
+        const word_t tail = ~word_t(0) >> (word_bits - 1 - (last - 1) % word_bits);
+        if (first_word == last_word)
+        {
+            if (value) words[first_word] |= head & tail; else words[first_word] &= ~(head & tail);
+            return;
+        }
+        if (value) words[first_word] |= head; else words[first_word] &= ~head;
+        for (std::size_t w = first_word + 1; w < last_word; ++w) words[w] = value ? ~word_t(0) : 0;
+        if (value) words[last_word] |= tail; else words[last_word] &= ~tail;
+    }
+
+public:
+    //--Constructors--
+    explicit checked_bit_vector(const allocator_t& a = allocator_t()) noexcept : alloc(a), words(nullptr), bit_count(0), word_capacity(0) {}
+    explicit checked_bit_vector(const std::size_t bits, const bool value = false, const allocator_t& a = allocator_t()) : checked_bit_vector(a) { resize(bits, value); }
+    checked_bit_vector(const checked_bit_vector& rhs) : checked_bit_vector(alloc_traits::select_on_container_copy_construction(rhs.alloc)) { *this = rhs; }
+    checked_bit_vector(checked_bit_vector&& rhs) noexcept : alloc(std::move(rhs.alloc)), words(rhs.words), bit_count(rhs.bit_count), word_capacity(rhs.word_capacity)
+    {
+        rhs.words = nullptr;
+        rhs.bit_count = rhs.word_capacity = 0;
+    }
+    ~checked_bit_vector() { release(); }
+
+    //--Copy Assignments--
+    checked_bit_vector& operator=(const checked_bit_vector& rhs)
+    {
+        if (this == &rhs) return *this;
+        if (alloc_traits::propagate_on_container_copy_assignment::value && alloc != rhs.alloc)
+        {
+            release();
+            alloc = rhs.alloc;
+        }
+        if (word_capacity < lines_for(rhs.bit_count))
+        {
+            word_t* fresh = alloc_traits::allocate(alloc, lines_for(rhs.bit_count));
+            release();
+            words = fresh;
+            word_capacity = lines_for(rhs.bit_count);
+        }
+        for (std::size_t w = 0; w < word_capacity; ++w) words[w] = w < rhs.word_capacity ? rhs.words[w] : 0;
+        bit_count = rhs.bit_count;
+        return *this;
+    }
+    checked_bit_vector& operator=(checked_bit_vector&& rhs) noexcept(alloc_traits::propagate_on_container_move_assignment::value || alloc_traits::is_always_equal::value)
+    {
+        if (this == &rhs) return *this;
+        if (alloc_traits::propagate_on_container_move_assignment::value || alloc == rhs.alloc)
+        {
+            release();
+            if (alloc_traits::propagate_on_container_move_assignment::value) alloc = std::move(rhs.alloc);
+            words = rhs.words;
+            bit_count = rhs.bit_count;
+            word_capacity = rhs.word_capacity;
+            rhs.words = nullptr;
+            rhs.bit_count = rhs.word_capacity = 0;
+            return *this;
+        }
+        return *this = static_cast<const checked_bit_vector&>(rhs);
+    }
+
+    //--Size--
+    std::size_t size() const noexcept { return bit_count; }
+    bool empty() const noexcept { return bit_count == 0; }
+    std::size_t capacity() const noexcept { return word_capacity * word_bits; }
+    allocator_t get_allocator() const noexcept { return alloc; }
+    //the words, bit i is bit i % 64 of word i / 64. Bits above size() are zero.
+    const word_t* data() const noexcept { return words; }
+
+    void reserve(const std::size_t bits)
+    {
+        if (lines_for(bits) <= word_capacity) return;
+        word_t* fresh = alloc_traits::allocate(alloc, lines_for(bits));
+        for (std::size_t w = 0; w < lines_for(bits); ++w) fresh[w] = w < word_capacity ? words[w] : 0;
+        const std::size_t old = bit_count;
+        release();
+        words = fresh;
+        word_capacity = lines_for(bits);
+        bit_count = old;
+    }
+    //new bits are set to value
+    void resize(const std::size_t bits, const bool value = false)
+    {
+        if (bits > capacity()) reserve(bits > 2 * capacity() ? bits : 2 * capacity());
+        const std::size_t old = bit_count;
+        bit_count = bits;
+        if (bits > old)
+            fill(old, bits, value);
+        else if (words != nullptr)
+        {
+            std::fill(words + words_for(bits), words + words_for(old), word_t(0));
+            trim();
+        }
+    }
+
+    //--Single bits--
+    bool test(const std::size_t pos) const noexcept { assert(pos < bit_count); return (words[pos / word_bits] >> (pos % word_bits)) & 1; }
+    void set(const std::size_t pos) noexcept { assert(pos < bit_count); words[pos / word_bits] |= word_t(1) << (pos % word_bits); }
+    void clear(const std::size_t pos) noexcept { assert(pos < bit_count); words[pos / word_bits] &= ~(word_t(1) << (pos % word_bits)); }
+    void flip(const std::size_t pos) noexcept { assert(pos < bit_count); words[pos / word_bits] ^= word_t(1) << (pos % word_bits); }
+    bool operator[](const std::size_t pos) const noexcept { return test(pos); }
+
+    //--Bulk operations--
+    //sets/clears the bits [first, last)
+    void set_range(const std::size_t first, const std::size_t last) noexcept { assert(first <= last && last <= bit_count); fill(first, last, true); }
+    void clear_range(const std::size_t first, const std::size_t last) noexcept { assert(first <= last && last <= bit_count); fill(first, last, false); }
+    void set_all() noexcept { fill(0, bit_count, true); }
+    void clear_all() noexcept { for (std::size_t w = 0; w < word_count(); ++w) words[w] = 0; }
+    //combines with a vector of the same size
+    void and_with(const checked_bit_vector& rhs) noexcept { assert(rhs.bit_count == bit_count); bitfield_detail::wide_apply<bitfield_detail::op_and>(words, words, rhs.words, word_count()); }
+    void or_with(const checked_bit_vector& rhs) noexcept { assert(rhs.bit_count == bit_count); bitfield_detail::wide_apply<bitfield_detail::op_or>(words, words, rhs.words, word_count()); }
+    void xor_with(const checked_bit_vector& rhs) noexcept { assert(rhs.bit_count == bit_count); bitfield_detail::wide_apply<bitfield_detail::op_xor>(words, words, rhs.words, word_count()); }
+    //clears the bits set in rhs
+    void and_not_with(const checked_bit_vector& rhs) noexcept { assert(rhs.bit_count == bit_count); bitfield_detail::wide_apply<bitfield_detail::op_andnot>(words, words, rhs.words, word_count()); }
+
+    //--Expressions--
+    //&, |, ^ and ~ build a checked_bit_expr (see Bitfield.h) evaluated in one pass when it is assigned or
+    //compared. The operands must be the same size.
+    typedef bitfield_detail::expr_leaf<checked_bit_vector, word_t> expr_leaf_t;
+    template <typename op, typename rhs_t>
+    using expr_t = checked_bit_expr<bitfield_detail::expr_binary<op, expr_leaf_t, typename std::decay<decltype(std::declval<const rhs_t&>().expr_node())>::type>>;
+    expr_leaf_t expr_node() const noexcept
+    {
+        return expr_leaf_t{ words, word_count(), bit_count % word_bits == 0 ? ~word_t(0) : (word_t(1) << (bit_count % word_bits)) - 1 };
+    }
+    //a vector the size of the expression, holding its value
+    template <typename node_t>
+    checked_bit_vector(const checked_bit_expr<node_t>& rhs, const allocator_t& a = allocator_t()) : checked_bit_vector(expr_bits(rhs.expr_node()), false, a)
+    {
+        static_assert(std::is_same<typename node_t::domain, checked_bit_vector>::value, "expression must be of the same bit vector type");
+        bitfield_detail::expr_assign(words, rhs.expr_node(), word_count());
+    }
+    //evaluated straight into the vector when it is already the size of the expression, which may then use
+    //the vector itself. Otherwise the result is built in new storage.
+    template <typename node_t>
+    checked_bit_vector& operator=(const checked_bit_expr<node_t>& rhs)
+    {
+        static_assert(std::is_same<typename node_t::domain, checked_bit_vector>::value, "expression must be of the same bit vector type");
+        if (expr_bits(rhs.expr_node()) != bit_count) return *this = checked_bit_vector(rhs, alloc);
+        bitfield_detail::expr_assign(words, rhs.expr_node(), word_count());
+        return *this;
+    }
+    checked_bit_expr<bitfield_detail::expr_not<expr_leaf_t>> operator~() const noexcept { return checked_bit_expr<bitfield_detail::expr_not<expr_leaf_t>>({ expr_node() }); }
+    template <typename rhs_t> expr_t<bitfield_detail::op_and, rhs_t> operator&(const rhs_t& rhs) const noexcept { return expr_t<bitfield_detail::op_and, rhs_t>({ expr_node(), checked_operand(rhs) }); }
+    template <typename rhs_t> expr_t<bitfield_detail::op_or,  rhs_t> operator|(const rhs_t& rhs) const noexcept { return expr_t<bitfield_detail::op_or,  rhs_t>({ expr_node(), checked_operand(rhs) }); }
+    template <typename rhs_t> expr_t<bitfield_detail::op_xor, rhs_t> operator^(const rhs_t& rhs) const noexcept { return expr_t<bitfield_detail::op_xor, rhs_t>({ expr_node(), checked_operand(rhs) }); }
+    template <typename node_t> checked_bit_vector& operator&=(const checked_bit_expr<node_t>& rhs) noexcept { bitfield_detail::expr_assign(words, (*this & rhs).expr_node(), word_count()); return *this; }
+    template <typename node_t> checked_bit_vector& operator|=(const checked_bit_expr<node_t>& rhs) noexcept { bitfield_detail::expr_assign(words, (*this | rhs).expr_node(), word_count()); return *this; }
+    template <typename node_t> checked_bit_vector& operator^=(const checked_bit_expr<node_t>& rhs) noexcept { bitfield_detail::expr_assign(words, (*this ^ rhs).expr_node(), word_count()); return *this; }
+    checked_bit_vector& operator&=(const checked_bit_vector& rhs) noexcept { and_with(rhs); return *this; }
+    checked_bit_vector& operator|=(const checked_bit_vector& rhs) noexcept { or_with(rhs); return *this; }
+    checked_bit_vector& operator^=(const checked_bit_vector& rhs) noexcept { xor_with(rhs); return *this; }
+    template <typename node_t> bool operator==(const checked_bit_expr<node_t>& rhs) const noexcept { return expr_bits(rhs.expr_node()) == bit_count && (*this ^ rhs) == nullptr; }
+    template <typename node_t> bool operator!=(const checked_bit_expr<node_t>& rhs) const noexcept { return !(*this == rhs); }
+
+    //--Queries--
+    //number of set bits
+    std::size_t count() const noexcept
+    {
+        std::size_t n = 0;
+        for (std::size_t w = 0; w < word_count(); ++w) n += bitfield_detail::popcount(words[w]);
+        return n;
+    }
+    bool any() const noexcept { return bitfield_detail::find_nonzero_word(words, 0, word_count()) != word_count(); }
+    bool none() const noexcept { return !any(); }
+    //index of the first set bit at or after pos, npos if there is none. Zero words are skipped a vector at a time.
+    std::size_t find_next(const std::size_t pos) const noexcept
+    {
+        if (pos >= bit_count) return npos;
+        std::size_t w = pos / word_bits;
+        const word_t first = words[w] & (~word_t(0) << (pos % word_bits));
+        if (first != 0) return w * word_bits + bitfield_detail::countr_zero(first);
+        w = bitfield_detail::find_nonzero_word(words, w + 1, word_count());
+        return w == word_count() ? npos : w * word_bits + bitfield_detail::countr_zero(words[w]);
+    }
+    std::size_t find_first() const noexcept { return find_next(0); }
+
+    bool operator==(const checked_bit_vector& rhs) const noexcept
+    {
+        return bit_count == rhs.bit_count && (bit_count == 0 || bitfield_detail::wide_none<bitfield_detail::op_xor>(words, rhs.words, word_count()));
+    }
+    bool operator!=(const checked_bit_vector& rhs) const noexcept { return !(*this == rhs); }
+
+    void swap(checked_bit_vector& rhs) noexcept
+    {
+        using std::swap;
+        if (alloc_traits::propagate_on_container_swap::value) swap(alloc, rhs.alloc);
+        swap(words, rhs.words);
+        swap(bit_count, rhs.bit_count);
+        swap(word_capacity, rhs.word_capacity);
+    }
+};
+
+//bit vector type declaration sharing the unique id of a BIT_FIELD - BIT_VECTOR(mybitfield, mybitvector);
+//Without _BITFIELD the fields share one id, so do the vectors.
+#define BIT_VECTOR( bitfield_t, bitvector_t ) typedef checked_bit_vector<bitfield_traits<bitfield_t>::unique_id> bitvector_t
@@ -0,0 +1,105 @@
+/*Copyright 2017 Jonathan Campbell
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.*/
+//bench - the small harness shared by the bench_checked and bench_plain targets
+#pragma once
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+//Every source is built twice, once with _BITFIELD (bench_checked) and once without (bench_plain), so the same
+//code is timed against the checked types and the plain integers. Benchmarks register themselves with BENCH and
+//print their own rows through bench_report. Run "bench_plain name" to run only the benchmarks whose name
+//contains "name".
+#ifdef _BITFIELD
+constexpr const char* bench_mode = "checked";
+#else
+constexpr const char* bench_mode = "plain";
+#endif
+
+struct bench_case
+{
+    const char* name;
+    void (*run)();
+};
+inline std::vector<bench_case>& bench_registry()
+{
+    static std::vector<bench_case> cases;
+    return cases;
+}
+struct bench_register
+{
+    bench_register(const char* name, void (*run)()) { bench_registry().push_back({ name, run }); }
+};
+//benchmark declaration - BENCH(ops_or) { ... }
+#define BENCH( name ) static void bench_##name(); static const bench_register bench_register_##name(#name, bench_##name); static void bench_##name()
+
+//keeps the compiler from dropping a computation whose result is otherwise unused
+template <typename T>
+inline void bench_keep(const T& value) noexcept
+{
+#if defined(__GNUC__) || defined(__clang__)
+    asm volatile("" : : "r,m"(value) : "memory");
+#else
+    static volatile char sink;
+    sink = *reinterpret_cast<const volatile char*>(&value);
+#endif
+}
+
+//nanoseconds for one call of f, the best of 5 runs of enough calls to take 20ms
+template <typename F>
+double bench_time(F&& f)
+{
+    typedef std::chrono::steady_clock clock;
+    f();
+    std::size_t calls = 1;
+    for (;;)
+    {
+        const clock::time_point start = clock::now();
+        for (std::size_t i = 0; i < calls; ++i) f();
+        if (clock::now() - start >= std::chrono::milliseconds(20) || calls >= (std::size_t(1) << 30)) break;
+        calls *= 2;
+    }
+    double best = 0;
+    for (int run = 0; run < 5; ++run)
+    {
+        const clock::time_point start = clock::now();
+        for (std::size_t i = 0; i < calls; ++i) f();
+        const double ns = std::chrono::duration<double, std::nano>(clock::now() - start).count() / static_cast<double>(calls);
+        if (run == 0 || ns < best) best = ns;
+    }
+    return best;
+}
+
+//one result row, value per unit - "ns/op", "MB", "Mops/s"
+inline void bench_report(const char* name, const double value, const char* unit)
+{
+    std::printf("%-8s %-48s %14.3f %s\n", bench_mode, name, value, unit);
+    std::fflush(stdout);
+}
+
+//small fast generator so the inputs are the same in both builds
+struct bench_random
+{
+    std::uint64_t state;
+    explicit bench_random(const std::uint64_t seed = 0x9E3779B97F4A7C15ull) noexcept : state(seed) {}
+    std::uint64_t operator()() noexcept
+    {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        return state;
+    }
+};
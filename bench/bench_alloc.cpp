@@ -0,0 +1,149 @@
+/*Copyright 2017 Jonathan Campbell
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.*/
+//allocator benchmarks - checked_bit_allocator from 1 to 64 threads, and a stress test of concurrent use
+#include "bench.h"
+#include "../Bitalloc.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <thread>
+
+BIT_FIELD(std::uint64_t, alloc_slots);
+#ifdef _BITFIELD
+bitfield_unique_id ui_alloc_slots;
+#endif
+BIT_ALLOCATOR(alloc_slots, slot_allocator);
+
+namespace
+{
+    //starts threads together, each running body(thread index), and returns the seconds until all are done
+    template <typename F>
+    double run_threads(const unsigned int threads, F&& body)
+    {
+        std::atomic<unsigned int> waiting(threads);
+        std::atomic<bool> go(false);
+        std::vector<std::thread> pool;
+        for (unsigned int t = 0; t < threads; ++t)
+        {
+            pool.emplace_back([&, t]
+            {
+                --waiting;
+                while (!go.load(std::memory_order_acquire)) std::this_thread::yield();
+                body(t);
+            });
+        }
+        while (waiting.load() != 0) std::this_thread::yield();
+        const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        go.store(true, std::memory_order_release);
+        for (std::thread& t : pool) t.join();
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    //the stress test fails the run rather than asserting, so it also checks builds with NDEBUG
+    void require(const bool ok, const char* what)
+    {
+        if (ok) return;
+        std::fprintf(stderr, "alloc_stress failed: %s\n", what);
+        std::exit(EXIT_FAILURE);
+    }
+}
+
+BENCH(alloc_scaling)
+{
+    //Each thread takes 16 ids and gives them back, over and over, the same total work for every thread count.
+    //Only scales as far as the machine has cores, past that it shows the cost of contention and preemption.
+    constexpr std::size_t total_rounds = std::size_t(1) << 16, held = 16;
+    slot_allocator alloc(std::size_t(1) << 16);
+    for (unsigned int threads = 1; threads <= 64; threads *= 2)
+    {
+        double best = 0;
+        for (int run = 0; run < 3; ++run)
+        {
+            const double seconds = run_threads(threads, [&](unsigned int)
+            {
+                std::size_t ids[held];
+                for (std::size_t round = 0; round < total_rounds / threads; ++round)
+                {
+                    for (std::size_t& id : ids) id = alloc.acquire();
+                    for (const std::size_t id : ids) alloc.release(id);
+                }
+            });
+            if (run == 0 || seconds < best) best = seconds;
+        }
+        const double ops = 2.0 * held * static_cast<double>(total_rounds / threads * threads);
+        bench_report(("alloc_scaling acquire+release " + std::to_string(threads) + " threads").c_str(), ops / best / 1e6, "Mops/s");
+    }
+    bench_report("alloc_scaling hardware threads", static_cast<double>(std::thread::hardware_concurrency()), "threads");
+}
+
+BENCH(alloc_stress)
+{
+    //16 threads acquire and release, singly and in batches, with fewer ids than they try to hold so acquire
+    //also runs out. owner records the thread holding each id, an id handed out twice is caught by exchange.
+    constexpr unsigned int threads = 16;
+    constexpr std::size_t capacity = 5000, hold_limit = 400, rounds = 200000;
+    slot_allocator alloc(capacity);
+    std::unique_ptr<std::atomic<unsigned int>[]> owner(new std::atomic<unsigned int>[capacity]);
+    for (std::size_t id = 0; id < capacity; ++id) owner[id].store(0);
+    std::atomic<std::size_t> acquired(0), double_issued(0), out_of_range(0);
+
+    const double seconds = run_threads(threads, [&](const unsigned int t)
+    {
+        std::vector<std::size_t> mine;
+        bench_random rnd(t + 1);
+        for (std::size_t round = 0; round < rounds; ++round)
+        {
+            const unsigned int action = static_cast<unsigned int>(rnd() % 8);
+            if (action < 5 && mine.size() < hold_limit)
+            {
+                const std::size_t id = alloc.acquire();
+                if (id == slot_allocator::npos) continue;
+                if (id >= capacity) { ++out_of_range; continue; }
+                if (owner[id].exchange(t + 1) != 0) ++double_issued;
+                mine.push_back(id);
+                ++acquired;
+            }
+            else if (action < 7 && !mine.empty())
+            {
+                const std::size_t id = mine.back();
+                mine.pop_back();
+                owner[id].store(0);
+                alloc.release(id);
+            }
+            else if (!mine.empty())
+            {
+                std::sort(mine.begin(), mine.end());
+                for (const std::size_t id : mine) owner[id].store(0);
+                alloc.release_batch(mine.data(), mine.size());
+                mine.clear();
+            }
+        }
+        for (const std::size_t id : mine) owner[id].store(0);
+        alloc.release_batch(mine.data(), mine.size());
+    });
+
+    require(out_of_range == 0, "an id past the capacity was handed out");
+    require(double_issued == 0, "an id was handed out twice");
+    require(alloc.count() == 0, "ids are still taken after every thread released its ids");
+    //every id can be acquired again, each once
+    std::vector<std::size_t> all;
+    for (std::size_t n = 0; n < capacity; ++n) all.push_back(alloc.acquire());
+    require(alloc.acquire() == slot_allocator::npos, "more ids than the capacity were handed out");
+    std::sort(all.begin(), all.end());
+    for (std::size_t n = 0; n < capacity; ++n) require(all[n] == n, "the ids after the stress test are not each id once");
+    bench_report("alloc_stress acquires, 16 threads", static_cast<double>(acquired.load()), "ids");
+    bench_report("alloc_stress acquire/release rate", static_cast<double>(threads * rounds) / seconds / 1e6, "Mops/s");
+}
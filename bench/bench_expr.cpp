@@ -0,0 +1,93 @@
+/*Copyright 2017 Jonathan Campbell
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.*/
+//expression benchmarks - r = ((a & b) | c) ^ d evaluated fused in one pass against eager evaluation
+#include "bench.h"
+#include "../Bitvector.h"
+#include <string>
+
+//The fused rows assign the expression, which reads the four operands and writes r once per word. The eager
+//rows evaluate one operator at a time, either into new temporaries, as operators returning a value would, or
+//in place with the compound operators, and go over memory three times. The difference grows once the
+//operands no longer fit in cache.
+BIT_FIELD(std::uint64_t, expr_flags);
+WIDE_BIT_FIELD(512, expr_wide512);
+WIDE_BIT_FIELD(32768, expr_wide4k);
+#ifdef _BITFIELD
+bitfield_unique_id ui_expr_flags;
+bitfield_unique_id ui_expr_wide512;
+bitfield_unique_id ui_expr_wide4k;
+#endif
+BIT_VECTOR(expr_flags, expr_vector);
+
+namespace
+{
+    std::string row(const char* what, const std::size_t bytes)
+    {
+        char size[32];
+        if (bytes >= (std::size_t(1) << 20)) std::snprintf(size, sizeof(size), "%zuMB", bytes >> 20);
+        else std::snprintf(size, sizeof(size), "%zuKB", bytes >> 10);
+        return std::string("expr_") + what + " " + size;
+    }
+
+    void fill(expr_vector& v, bench_random& rnd)
+    {
+        for (std::size_t i = 0; i < v.size(); i += 64)
+        {
+            const std::uint64_t w = rnd();
+            for (std::size_t b = 0; b < 64; ++b) if (((w >> b) & 1) != 0) v.set(i + b);
+        }
+    }
+
+    template <typename field_t>
+    void run_wide(const char* name)
+    {
+        //the values don't change the time of the operators, only that the operands differ
+        const field_t a = ~field_t(), b = a << 3, c = a >> 7, d = (b ^ c) << 1;
+        field_t r;
+        const double fused = bench_time([&] { r = ((a & b) | c) ^ d; bench_keep(r); });
+        const double temporaries = bench_time([&] { const field_t t1 = a & b; const field_t t2 = t1 | c; r = t2 ^ d; bench_keep(r); });
+        const double in_place = bench_time([&] { r = a; r &= b; r |= c; r ^= d; bench_keep(r); });
+        const std::string prefix = std::string("expr_wide ") + name;
+        bench_report((prefix + " fused").c_str(), fused, "ns/op");
+        bench_report((prefix + " eager temporaries").c_str(), temporaries, "ns/op");
+        bench_report((prefix + " eager in place").c_str(), in_place, "ns/op");
+    }
+}
+
+BENCH(expr_vector)
+{
+    //each operand from 4KB to 64MB, r = ((a & b) | c) ^ d
+    for (std::size_t bytes = std::size_t(4) << 10; bytes <= (std::size_t(64) << 20); bytes *= 4)
+    {
+        bench_random rnd(bytes);
+        expr_vector a(bytes * 8), b(bytes * 8), c(bytes * 8), d(bytes * 8), r(bytes * 8);
+        fill(a, rnd);
+        fill(b, rnd);
+        fill(c, rnd);
+        fill(d, rnd);
+        const double fused = bench_time([&] { r = ((a & b) | c) ^ d; bench_keep(r); });
+        const double temporaries = bench_time([&] { const expr_vector t1 = a & b; const expr_vector t2 = t1 | c; r = t2 ^ d; bench_keep(r); });
+        const double in_place = bench_time([&] { r = a; r &= b; r |= c; r ^= d; bench_keep(r); });
+        bench_report(row("vector fused", bytes).c_str(), fused / 1000, "us/op");
+        bench_report(row("vector eager temporaries", bytes).c_str(), temporaries / 1000, "us/op");
+        bench_report(row("vector eager in place", bytes).c_str(), in_place / 1000, "us/op");
+        bench_report(row("vector fused speedup", bytes).c_str(), in_place / fused, "x");
+    }
+}
+
+BENCH(expr_wide)
+{
+    run_wide<expr_wide512>("512 bits");
+    run_wide<expr_wide4k>("4KB");
+}
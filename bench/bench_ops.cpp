@@ -0,0 +1,145 @@
+/*Copyright 2017 Jonathan Campbell
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.*/
+//operator microbenchmarks - every operator family of BIT_FIELD, timed in the checked and the plain build
+#include "bench.h"
+#include "../Bitfield.h"
+#include <algorithm>
+
+//Each benchmark runs one operator family over records, an array of 64K fields (256KB, in L2), and reports the
+//time per record. The code is written as plain integer code would be, so it compiles unchanged in both builds
+//and the two results of a row should match.
+BIT_FIELD(std::uint32_t, ops_flags);
+#ifdef _BITFIELD
+bitfield_unique_id ui_ops_flags;
+#endif
+BIT_MASK(ops_flags, OPS_READY, 1);
+BIT_MASK(ops_flags, OPS_BUSY, 2);
+BIT_MASK(ops_flags, OPS_DIRTY, 5);
+BIT_MASK(ops_flags, OPS_ERROR, 9);
+BIT_MASK(ops_flags, OPS_DONE, 17);
+BIT_MASK(ops_flags, OPS_HIGH, 32);
+
+namespace
+{
+    constexpr std::size_t record_count = std::size_t(1) << 16;
+
+    std::vector<ops_flags>& records()
+    {
+        static std::vector<ops_flags> r = []
+        {
+            std::vector<ops_flags> init(record_count);
+            bench_random rnd;
+            for (ops_flags& f : init) f = bitfield_traits<ops_flags>::to_field(static_cast<std::uint32_t>(rnd()));
+            return init;
+        }();
+        return r;
+    }
+
+    template <typename F>
+    void run(const char* name, F&& f)
+    {
+        bench_report(name, bench_time(f) / static_cast<double>(record_count), "ns/op");
+    }
+}
+
+BENCH(ops_assign)
+{
+    std::vector<ops_flags>& r = records();
+    run("ops_assign          f = MASK", [&] { for (ops_flags& f : r) f = OPS_DIRTY; bench_keep(r[0]); });
+    run("ops_assign          f = 0", [&] { for (ops_flags& f : r) f = 0; bench_keep(r[0]); });
+    std::vector<ops_flags> copy(record_count);
+    run("ops_copy            copy records", [&] { std::copy(r.begin(), r.end(), copy.begin()); bench_keep(copy[0]); });
+    run("ops_copy            f = g", [&] { for (std::size_t i = 0; i < record_count; ++i) copy[i] = r[record_count - 1 - i]; bench_keep(copy[0]); });
+}
+
+BENCH(ops_compound)
+{
+    std::vector<ops_flags>& r = records();
+    run("ops_compound        f |= MASK", [&] { for (ops_flags& f : r) f |= OPS_BUSY; bench_keep(r[0]); });
+    run("ops_compound        f &= ~MASK", [&] { for (ops_flags& f : r) f &= ~OPS_BUSY; bench_keep(r[0]); });
+    run("ops_compound        f ^= MASK", [&] { for (ops_flags& f : r) f ^= OPS_ERROR; bench_keep(r[0]); });
+    run("ops_compound        f |= g", [&] { for (std::size_t i = 1; i < record_count; ++i) r[i] |= r[i - 1]; bench_keep(r[0]); });
+}
+
+BENCH(ops_bitwise)
+{
+    std::vector<ops_flags>& r = records();
+    run("ops_bitwise         (f & A) | B", [&] { ops_flags acc = 0; for (const ops_flags& f : r) acc ^= (f & OPS_READY) | OPS_DONE; bench_keep(acc); });
+    run("ops_bitwise         ~f & (A | B)", [&] { ops_flags acc = 0; for (const ops_flags& f : r) acc ^= ~f & (OPS_READY | OPS_HIGH); bench_keep(acc); });
+    run("ops_bitwise         f ^ g", [&] { ops_flags acc = 0; for (std::size_t i = 1; i < record_count; ++i) acc |= r[i] ^ r[i - 1]; bench_keep(acc); });
+    run("ops_shift           (f << 3) | (f >> 5)", [&] { ops_flags acc = 0; for (const ops_flags& f : r) acc ^= (f << 3) | (f >> 5); bench_keep(acc); });
+}
+
+BENCH(ops_compare)
+{
+    std::vector<ops_flags>& r = records();
+    run("ops_compare         (f & MASK) != 0", [&] { std::size_t n = 0; for (const ops_flags& f : r) n += (f & OPS_DIRTY) != 0; bench_keep(n); });
+    run("ops_compare         f == MASK", [&] { std::size_t n = 0; for (const ops_flags& f : r) n += f == OPS_DIRTY; bench_keep(n); });
+    run("ops_compare         f == g", [&] { std::size_t n = 0; for (std::size_t i = 1; i < record_count; ++i) n += r[i] == r[i - 1]; bench_keep(n); });
+    run("ops_compare         if (f & MASK) / !f", [&] { std::size_t n = 0; for (const ops_flags& f : r) { if (f & OPS_HIGH) ++n; if (!f) ++n; } bench_keep(n); });
+}
+
+BENCH(ops_query)
+{
+    std::vector<ops_flags>& r = records();
+    run("ops_query           bitfield_count", [&] { std::size_t n = 0; for (const ops_flags& f : r) n += bitfield_count(f); bench_keep(n); });
+    run("ops_query           bitfield_all(f, A | B)", [&] { std::size_t n = 0; for (const ops_flags& f : r) n += bitfield_all(f, OPS_READY | OPS_BUSY); bench_keep(n); });
+    run("ops_query           bitfield_first_set", [&] { std::size_t n = 0; for (const ops_flags& f : r) n += bitfield_first_set(f); bench_keep(n); });
+    run("ops_query           bitfield_each_set_bit", [&] { std::size_t n = 0; for (const ops_flags& f : r) for (auto bit : bitfield_each_set_bit(f)) { bench_keep(bit); ++n; } bench_keep(n); });
+}
+
+BENCH(ops_volatile)
+{
+    //a volatile field is read and written on every access in both builds
+    static volatile ops_flags v;
+    run("ops_volatile        v |= MASK; v &= ~MASK", [&] { for (std::size_t i = 0; i < record_count; ++i) { v |= OPS_BUSY; v &= ~OPS_BUSY; } });
+    run("ops_volatile        (v & MASK) != 0", [&] { std::size_t n = 0; for (std::size_t i = 0; i < record_count; ++i) n += (v & OPS_READY) != 0; bench_keep(n); });
+    run("ops_volatile        v = MASK; g = v", [&] { ops_flags g = 0; for (std::size_t i = 0; i < record_count; ++i) { v = OPS_DONE; g = v; } bench_keep(g); });
+}
+
+BENCH(ops_state_machine)
+{
+    //a flag-heavy loop, each record steps through ready -> busy -> done with an occasional error. The second
+    //row tests ready and not done with two tests joined by &&, which GCC only merges into one for plain integers
+    //(see tools/codegen_parity.cpp), the first tests both bits in one mask and compiles the same in both builds.
+    std::vector<ops_flags>& r = records();
+    run("ops_state_machine   step records", [&]
+    {
+        for (ops_flags& f : r)
+        {
+            if ((f & OPS_ERROR) != 0) f &= ~(OPS_BUSY | OPS_ERROR);
+            else if ((f & OPS_BUSY) != 0) { f &= ~OPS_BUSY; f |= OPS_DONE | OPS_DIRTY; }
+            else if ((f & (OPS_READY | OPS_DONE)) == OPS_READY) { f |= OPS_BUSY; f &= ~OPS_READY; }
+            else f ^= OPS_READY;
+        }
+        bench_keep(r[0]);
+    });
+    run("ops_state_machine   step records, A && !B", [&]
+    {
+        for (ops_flags& f : r)
+        {
+            if ((f & OPS_ERROR) != 0) f &= ~(OPS_BUSY | OPS_ERROR);
+            else if ((f & OPS_BUSY) != 0) { f &= ~OPS_BUSY; f |= OPS_DONE | OPS_DIRTY; }
+            else if ((f & OPS_READY) != 0 && (f & OPS_DONE) == 0) { f |= OPS_BUSY; f &= ~OPS_READY; }
+            else f ^= OPS_READY;
+        }
+        bench_keep(r[0]);
+    });
+    run("ops_state_machine   count ready", [&]
+    {
+        std::size_t n = 0;
+        for (const ops_flags& f : r) n += (f & (OPS_READY | OPS_BUSY)) == OPS_READY && !(f & OPS_ERROR);
+        bench_keep(n);
+    });
+}
@@ -0,0 +1,121 @@
+/*Copyright 2017 Jonathan Campbell
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.*/
+//dense against sparse benchmark - checked_bit_vector and checked_sparse_bit_vector over a density sweep
+#include "bench.h"
+#include "../Bitsparse.h"
+#include "../Bitvector.h"
+#include <string>
+
+//Both vectors hold the same random bits of a 2^24 bit universe, from a handful of bits up to half of them.
+//Each density reports the bytes held and the time to build the vector, to test random bits, to intersect
+//two vectors (a copy and and_with) and to count, then the lowest density at which the dense vector wins.
+BIT_FIELD(std::uint64_t, sparse_flags);
+#ifdef _BITFIELD
+bitfield_unique_id ui_sparse_flags;
+#endif
+BIT_VECTOR(sparse_flags, dense_vector);
+SPARSE_BIT_VECTOR(sparse_flags, sparse_vector);
+
+namespace
+{
+    constexpr std::uint32_t universe = std::uint32_t(1) << 24;
+    constexpr std::size_t lookups = 4096;
+
+    //one density, dense and sparse
+    struct sparse_row
+    {
+        double density;
+        double bytes[2], build[2], test[2], intersect[2], count[2];
+    };
+
+    std::string row(const char* what, const double density, const char* kind)
+    {
+        char text[64];
+        std::snprintf(text, sizeof(text), "sparse_%s %.4f%% %s", what, density * 100, kind);
+        return text;
+    }
+
+    std::vector<std::uint32_t> positions(const double density, const std::uint64_t seed)
+    {
+        bench_random rnd(seed);
+        std::vector<std::uint32_t> p(static_cast<std::size_t>(density * universe) + 1);
+        for (std::uint32_t& i : p) i = static_cast<std::uint32_t>(rnd() % universe);
+        return p;
+    }
+
+    std::size_t memory_of(const dense_vector& v) { return sizeof(v) + v.capacity() / 8; }
+    std::size_t memory_of(const sparse_vector& v) { return v.memory_usage(); }
+
+    //times one vector type, index 0 dense and 1 sparse
+    template <typename vector_t>
+    void measure(sparse_row& r, const int kind, vector_t& a, vector_t& b, const std::vector<std::uint32_t>& pa, const std::vector<std::uint32_t>& pb, const std::vector<std::uint32_t>& probes)
+    {
+        r.build[kind] = bench_time([&] { a.clear_all(); for (const std::uint32_t i : pa) a.set(i); bench_keep(a); });
+        for (const std::uint32_t i : pb) b.set(i);
+        r.bytes[kind] = static_cast<double>(memory_of(a));
+        r.test[kind] = bench_time([&] { std::size_t n = 0; for (const std::uint32_t i : probes) n += a.test(i); bench_keep(n); }) / lookups;
+        r.intersect[kind] = bench_time([&] { vector_t t = a; t.and_with(b); bench_keep(t); });
+        r.count[kind] = bench_time([&] { bench_keep(a.count()); });
+    }
+
+    //lowest density from which the dense vector is smaller or faster, the sweep is in increasing density.
+    //Reported in set bits per million, as the low end doesn't show as a percentage.
+    void crossover(const std::vector<sparse_row>& rows, const char* what, double (sparse_row::*value)[2])
+    {
+        for (const sparse_row& r : rows)
+        {
+            if ((r.*value)[0] <= (r.*value)[1])
+            {
+                bench_report((std::string("sparse_crossover ") + what).c_str(), r.density * 1e6, "ppm");
+                return;
+            }
+        }
+        bench_report((std::string("sparse_crossover ") + what + ", sparse wins up to").c_str(), rows.back().density * 1e6, "ppm");
+    }
+}
+
+BENCH(sparse_density)
+{
+    static const double densities[] = { 0.000001, 0.00001, 0.0001, 0.001, 0.005, 0.01, 0.02, 0.05, 0.1, 0.25, 0.5 };
+    const std::vector<std::uint32_t> probes = positions(static_cast<double>(lookups - 1) / universe, 1);
+    std::vector<sparse_row> rows;
+    for (const double density : densities)
+    {
+        sparse_row r = { density, {}, {}, {}, {}, {} };
+        const std::vector<std::uint32_t> pa = positions(density, 2), pb = positions(density, 3);
+        {
+            dense_vector a(universe), b(universe);
+            measure(r, 0, a, b, pa, pb, probes);
+        }
+        {
+            sparse_vector a, b;
+            measure(r, 1, a, b, pa, pb, probes);
+        }
+        for (int kind = 0; kind < 2; ++kind)
+        {
+            const char* name = kind == 0 ? "dense" : "sparse";
+            bench_report(row("bytes", density, name).c_str(), r.bytes[kind] / 1024, "KB");
+            bench_report(row("build", density, name).c_str(), r.build[kind] / 1000, "us/op");
+            bench_report(row("test", density, name).c_str(), r.test[kind], "ns/op");
+            bench_report(row("and_with", density, name).c_str(), r.intersect[kind] / 1000, "us/op");
+            bench_report(row("count", density, name).c_str(), r.count[kind] / 1000, "us/op");
+        }
+        rows.push_back(r);
+    }
+    crossover(rows, "bytes", &sparse_row::bytes);
+    crossover(rows, "build", &sparse_row::build);
+    crossover(rows, "test", &sparse_row::test);
+    crossover(rows, "and_with", &sparse_row::intersect);
+    crossover(rows, "count", &sparse_row::count);
+}
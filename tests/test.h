@@ -0,0 +1,70 @@
+/*Copyright 2017 Jonathan Campbell
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.*/
+//test - the checks shared by the test targets
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+//Every test is built twice, once with _BITFIELD (name_checked) and once without (name_plain), and checks the
+//types against a plain scalar reference - std::bitset, std::set or a loop over bits. The instrumentation test
+//is also built with _BITFIELD_INSTRUMENT (name_instrumented). Tests register themselves with TEST and report
+//failed checks through TEST_CHECK, which fails the run rather than asserting, so the tests also check builds
+//with NDEBUG. Run "test_bitfield_plain name" to run only the tests whose name contains "name".
+#if defined(_BITFIELD_INSTRUMENT)
+constexpr const char* test_mode = "instrumented";
+#elif defined(_BITFIELD)
+constexpr const char* test_mode = "checked";
+#else
+constexpr const char* test_mode = "plain";
+#endif
+
+struct test_case
+{
+    const char* name;
+    void (*run)();
+};
+inline std::vector<test_case>& test_registry()
+{
+    static std::vector<test_case> cases;
+    return cases;
+}
+struct test_register
+{
+    test_register(const char* name, void (*run)()) { test_registry().push_back({ name, run }); }
+};
+//test declaration - TEST(wide_shift) { ... }
+#define TEST( name ) static void test_##name(); static const test_register test_register_##name(#name, test_##name); static void test_##name()
+
+inline std::size_t& test_failures()
+{
+    static std::size_t failures = 0;
+    return failures;
+}
+#define TEST_CHECK( ... ) do { if (!(__VA_ARGS__)) { std::fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #__VA_ARGS__); ++test_failures(); } } while (0)
+
+//xorshift, the same numbers on every platform unlike the std distributions. seed must not be 0.
+struct test_random
+{
+    std::uint64_t state;
+    explicit test_random(const std::uint64_t seed = 0x9E3779B97F4A7C15ull) noexcept : state(seed) {}
+    std::uint64_t operator()() noexcept
+    {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        return state;
+    }
+};
@@ -0,0 +1,159 @@
+/*Copyright 2017 Jonathan Campbell
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.*/
+//checked_bit_allocator checked against a std::vector<bool> of the ids taken, and ids shared out between threads
+#include "test.h"
+#include "../Bitalloc.h"
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+BIT_FIELD(std::uint64_t, slots);
+BIT_FIELD(std::uint8_t, small_slots);
+#ifdef _BITFIELD
+bitfield_unique_id ui_slots;
+bitfield_unique_id ui_small_slots;
+#endif
+BIT_ALLOCATOR(slots, slot_allocator);
+BIT_ALLOCATOR(small_slots, small_allocator);
+
+namespace
+{
+    typedef std::vector<bool> reference;
+
+    //the id acquire_near(hint) gives - the first free id at or after hint in its leaf, then before it in the
+    //leaf, then in the following leaves, wrapping round to the first
+    std::size_t near_of(const reference& taken, const std::size_t word_bits, std::size_t hint)
+    {
+        hint %= taken.size();
+        const std::size_t leaf = hint / word_bits, leaves = (taken.size() + word_bits - 1) / word_bits;
+        for (std::size_t b = hint % word_bits; b < word_bits && leaf * word_bits + b < taken.size(); ++b)
+            if (!taken[leaf * word_bits + b]) return leaf * word_bits + b;
+        for (std::size_t k = 0; k < leaves; ++k)
+        {
+            const std::size_t l = (leaf + k) % leaves;
+            for (std::size_t b = 0; b < word_bits && l * word_bits + b < taken.size(); ++b)
+                if (!taken[l * word_bits + b]) return l * word_bits + b;
+        }
+        return static_cast<std::size_t>(-1);
+    }
+
+    template <typename allocator_t>
+    bool same(const allocator_t& a, const reference& taken)
+    {
+        std::size_t n = 0;
+        for (std::size_t id = 0; id < taken.size(); ++id)
+        {
+            if (a.is_acquired(id) != taken[id]) return false;
+            n += taken[id];
+        }
+        return a.count() == n;
+    }
+
+    template <typename allocator_t>
+    void check_allocator(const std::size_t capacity, const std::uint64_t seed)
+    {
+        const std::size_t word_bits = allocator_t::word_bits;
+        allocator_t a(capacity);
+        reference taken(capacity);
+        TEST_CHECK(a.capacity() == capacity && a.count() == 0);
+
+        //every id once, then none
+        for (std::size_t n = 0; n < capacity; ++n)
+        {
+            const std::size_t id = a.acquire();
+            TEST_CHECK(id < capacity && !taken[id]);
+            if (id < capacity) taken[id] = true;
+        }
+        TEST_CHECK(a.acquire() == allocator_t::npos && a.acquire_near(0) == allocator_t::npos);
+        TEST_CHECK(same(a, taken));
+
+        test_random rnd(seed);
+        for (int round = 0; round < 2000; ++round)
+        {
+            const unsigned int action = static_cast<unsigned int>(rnd() % 4);
+            if (action == 0)
+            {
+                const std::size_t id = rnd() % capacity;
+                if (!taken[id]) continue;
+                a.release(id);
+                taken[id] = false;
+            }
+            else if (action == 1)
+            {
+                //a sorted batch spanning a few leaves
+                std::vector<std::size_t> ids;
+                const std::size_t first = rnd() % capacity;
+                for (std::size_t id = first; id < capacity && id < first + 3 * word_bits; ++id)
+                    if (taken[id] && rnd() % 2 == 0) ids.push_back(id);
+                a.release_batch(ids.data(), ids.size());
+                for (const std::size_t id : ids) taken[id] = false;
+            }
+            else
+            {
+                const std::size_t hint = rnd() % (2 * capacity);
+                const std::size_t expected = near_of(taken, word_bits, hint), id = a.acquire_near(hint);
+                TEST_CHECK(id == expected);
+                if (id < capacity) taken[id] = true;
+            }
+        }
+        TEST_CHECK(same(a, taken));
+    }
+}
+
+TEST(alloc_ids)
+{
+    for (const std::size_t capacity : { 1, 7, 63, 64, 65, 1000, 64 * 64 + 5, 64 * 64 * 3 })
+    {
+        check_allocator<slot_allocator>(capacity, capacity + 1);
+        check_allocator<small_allocator>(capacity, capacity + 2);
+    }
+    slot_allocator none(0);
+    TEST_CHECK(none.acquire() == slot_allocator::npos && none.count() == 0);
+}
+
+TEST(alloc_threads)
+{
+    //the threads take every id between them, each once, then give them all back
+    constexpr unsigned int threads = 4;
+    constexpr std::size_t capacity = 20000;
+    slot_allocator a(capacity);
+    std::vector<std::size_t> ids[threads];
+    std::vector<std::thread> pool;
+    for (unsigned int t = 0; t < threads; ++t)
+    {
+        pool.emplace_back([&a, &ids, t]
+        {
+            for (std::size_t id; (id = a.acquire()) != slot_allocator::npos;) ids[t].push_back(id);
+        });
+    }
+    for (std::thread& t : pool) t.join();
+    std::vector<std::size_t> all;
+    for (const std::vector<std::size_t>& mine : ids) all.insert(all.end(), mine.begin(), mine.end());
+    std::sort(all.begin(), all.end());
+    TEST_CHECK(all.size() == capacity && a.count() == capacity);
+    for (std::size_t n = 0; n < all.size(); ++n) TEST_CHECK(all[n] == n);
+
+    pool.clear();
+    for (unsigned int t = 0; t < threads; ++t)
+    {
+        pool.emplace_back([&a, &ids, t]
+        {
+            std::sort(ids[t].begin(), ids[t].end());
+            a.release_batch(ids[t].data(), ids[t].size() / 2);
+            for (std::size_t k = ids[t].size() / 2; k < ids[t].size(); ++k) a.release(ids[t][k]);
+        });
+    }
+    for (std::thread& t : pool) t.join();
+    TEST_CHECK(a.count() == 0);
+}
@@ -0,0 +1,144 @@
+/*Copyright 2017 Jonathan Campbell
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.*/
+//the batch functions of Bitbatch.h checked against a loop over the records
+#include "test.h"
+#include "../Bitbatch.h"
+#include <algorithm>
+#include <array>
+
+BIT_FIELD(std::uint8_t, flags8);
+BIT_FIELD(std::uint16_t, flags16);
+BIT_FIELD(std::uint32_t, flags32);
+BIT_FIELD(std::uint64_t, flags64);
+BIT_MASK(flags32, READ, 1);
+BIT_MASK(flags32, WRITE, 2);
+BIT_MASK(flags32, EXEC, 32);
+#ifdef _BITFIELD
+bitfield_unique_id ui_flags8;
+bitfield_unique_id ui_flags16;
+bitfield_unique_id ui_flags32;
+bitfield_unique_id ui_flags64;
+#endif
+
+namespace
+{
+    const bitfield_match modes[] = { bitfield_match::any, bitfield_match::all, bitfield_match::none };
+
+    template <typename word_t>
+    bool matches(const word_t w, const word_t m, const bitfield_match match)
+    {
+        return match == bitfield_match::any ? (w & m) != 0 : (match == bitfield_match::all ? (w & m) == m : (w & m) == 0);
+    }
+
+    //every count up to a few vectors past the widest kernel, from every offset in a vector so the loads
+    //start unaligned and the scalar tails get each length
+    template <typename field_t>
+    void check_batch(const std::uint64_t seed)
+    {
+        typedef bitfield_traits<field_t> traits;
+        typedef typename traits::word_t word_t;
+        test_random rnd(seed);
+        std::vector<field_t> records(300);
+        std::vector<word_t> words(records.size());
+        std::vector<std::size_t> out(records.size() + 1), expected;
+        for (std::size_t n = 0; n + 16 <= records.size(); n += n < 80 ? 1 : 37)
+        {
+            const std::size_t offset = n % 16;
+            const word_t m = static_cast<word_t>(rnd() & rnd() & rnd()) | static_cast<word_t>(1);
+            for (std::size_t i = 0; i < records.size(); ++i)
+            {
+                //about a quarter of the records hold all of m, the rest random bits
+                words[i] = rnd() % 4 == 0 ? static_cast<word_t>(m | rnd()) : static_cast<word_t>(rnd() & rnd());
+                records[i] = traits::to_field(words[i]);
+            }
+            const field_t mask = traits::to_field(m);
+            const field_t* p = records.data() + offset;
+            for (const bitfield_match match : modes)
+            {
+                expected.clear();
+                for (std::size_t i = 0; i < n; ++i)
+                    if (matches(words[offset + i], m, match)) expected.push_back(i);
+                TEST_CHECK(count_matching(p, n, mask, match) == expected.size());
+                TEST_CHECK(any_matching(p, n, mask, match) == !expected.empty());
+                out[n] = 12345;
+                const std::size_t found = filter_indices(p, n, mask, out.data(), match);
+                TEST_CHECK(found == expected.size() && std::equal(expected.begin(), expected.end(), out.begin()));
+                //filter_indices writes no further than n indices
+                TEST_CHECK(out[n] == 12345);
+            }
+            TEST_CHECK(count_matching(p, n, mask) == count_matching(p, n, mask, bitfield_match::all));
+
+            //bulk updates leave the records outside [offset, offset + n) alone
+            const word_t k = static_cast<word_t>(rnd());
+            bulk_or(records.data() + offset, n, mask);
+            bulk_and(records.data() + offset, n, traits::to_field(k));
+            bool updated = true;
+            for (std::size_t i = 0; i < records.size(); ++i)
+            {
+                const word_t w = i >= offset && i < offset + n ? static_cast<word_t>((words[i] | m) & k) : words[i];
+                updated = updated && traits::to_word(records[i]) == w;
+            }
+            TEST_CHECK(updated);
+        }
+    }
+}
+
+TEST(batch)
+{
+    check_batch<flags8>(1);
+    check_batch<flags16>(2);
+    check_batch<flags32>(3);
+    check_batch<flags64>(4);
+}
+
+TEST(batch_masks)
+{
+    flags32 records[40] = {};
+    for (std::size_t i = 0; i < 40; i += 2) records[i] |= READ;
+    for (std::size_t i = 0; i < 40; i += 5) records[i] |= EXEC;
+    TEST_CHECK(count_matching(records, 40, READ) == 20);
+    TEST_CHECK(count_matching(records, 40, READ | EXEC) == 4);
+    TEST_CHECK(count_matching(records, 40, READ | EXEC, bitfield_match::any) == 24);
+    TEST_CHECK(count_matching(records, 40, READ | EXEC, bitfield_match::none) == 16);
+    TEST_CHECK(!any_matching(records, 40, WRITE));
+    std::size_t out[40];
+    TEST_CHECK(filter_indices(records, 40, EXEC, out) == 8 && out[0] == 0 && out[7] == 35);
+    bulk_or(records, 40, WRITE);
+    TEST_CHECK(count_matching(records, 40, WRITE) == 40);
+    bulk_and(records, 40, WRITE);
+    TEST_CHECK(count_matching(records, 40, WRITE | READ, bitfield_match::any) == 40 && count_matching(records, 40, READ) == 0);
+}
+
+#if defined(__cpp_lib_span) && defined(__cpp_lib_ranges)
+//the range forms, only built as C++20 - see the test_bitbatch_cxx20 targets
+TEST(batch_ranges)
+{
+    std::vector<flags32> v(100);
+    for (std::size_t i = 0; i < v.size(); i += 3) v[i] = READ;
+    TEST_CHECK(count_matching(v, READ) == 34);
+    TEST_CHECK(count_matching(std::span<flags32>(v), READ) == 34);
+    TEST_CHECK(count_matching(std::span<const flags32>(v), READ, bitfield_match::none) == 66);
+    const std::vector<flags32>& cv = v;
+    TEST_CHECK(any_matching(cv, READ) && !any_matching(cv, WRITE));
+    std::vector<std::size_t> out(v.size());
+    TEST_CHECK(filter_indices(v, READ, out) == 34 && out[1] == 3 && out[33] == 99);
+    bulk_or(std::span<flags32>(v).subspan(50), WRITE);
+    TEST_CHECK(count_matching(v, WRITE) == 50 && count_matching(std::span<const flags32>(v).first(50), WRITE) == 0);
+    bulk_and(v, READ);
+    TEST_CHECK(count_matching(v, WRITE, bitfield_match::none) == 100);
+    std::array<flags32, 4> a{};
+    bulk_or(a, READ | EXEC);
+    TEST_CHECK(count_matching(a, READ | EXEC) == 4);
+}
+#endif
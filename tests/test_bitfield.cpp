@@ -0,0 +1,487 @@
+/*Copyright 2017 Jonathan Campbell
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.*/
+//checked_bit_field and checked_wide_bit_field checked against std::bitset and plain integer references
+#include "test.h"
+#include "../Bitfield.h"
+#include <atomic>
+#include <bitset>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+BIT_FIELD(std::uint64_t, status);
+BIT_MASK(status, READY, 1);
+BIT_MASK(status, DONE, 2);
+BIT_MASK(status, FAILED, 64);
+ATOMIC_BIT_FIELD(status, atomic_status);
+BIT_FIELD(std::uint8_t, flags8);
+BIT_FIELD(std::uint16_t, flags16);
+BIT_FIELD(std::uint32_t, flags32);
+BIT_FIELD(std::uint64_t, header);
+BIT_MASK(header, VALID, 1);
+enum class job_state : unsigned char { idle, busy, done, failed };
+BIT_SUBFIELD(header, PRIORITY, 2, 3, unsigned int);
+BIT_SUBFIELD(header, STATE, 5, 4, job_state);
+BIT_SUBFIELD(header, URGENT, 9, 1, bool);
+BIT_SUBFIELD(header, LENGTH, 33, 32, std::uint64_t);
+BIT_SUBFIELD(flags16, LOW, 1, 5, unsigned int);
+BIT_SUBFIELD(flags16, HIGH, 10, 7, unsigned int);
+WIDE_BIT_FIELD(64, wide64);
+WIDE_BIT_FIELD(300, wide300);
+WIDE_BIT_FIELD(1024, wide1024);
+WIDE_BIT_MASK(wide300, WIDE_FIRST, 1);
+WIDE_BIT_MASK(wide300, WIDE_MIDDLE, 70);
+WIDE_BIT_MASK(wide300, WIDE_LAST, 300);
+WIDE_BIT_MASKS(wide300, WIDE_ENDS) = WIDE_FIRST | WIDE_LAST;
+#ifdef _BITFIELD
+bitfield_unique_id ui_status;
+bitfield_unique_id ui_flags8;
+bitfield_unique_id ui_flags16;
+bitfield_unique_id ui_flags32;
+bitfield_unique_id ui_header;
+bitfield_unique_id ui_wide64;
+bitfield_unique_id ui_wide300;
+bitfield_unique_id ui_wide1024;
+#endif
+
+namespace
+{
+    typedef bitfield_traits<status> status_traits;
+    status status_of(const std::uint64_t w) { return status_traits::to_field(w); }
+    std::uint64_t word_of(const status s) { return status_traits::to_word(s); }
+
+    //the field with only bit i set, counting from 0
+    template <typename field_t>
+    field_t single(const std::size_t i)
+    {
+        return field_t(field_t::fieldbit_t::template set_bit<1>()) << static_cast<unsigned int>(i);
+    }
+
+    template <std::size_t bits, typename field_t>
+    std::bitset<bits> bits_of(const field_t& f)
+    {
+        std::bitset<bits> b;
+        for (std::size_t i = 0; i < bits; ++i)
+            if ((f & single<field_t>(i)) != nullptr) b.set(i);
+        return b;
+    }
+
+    //about one bit in density set, the same bits in the field and in ref
+    template <typename field_t, std::size_t bits>
+    field_t random_field(test_random& rnd, std::bitset<bits>& ref, const unsigned int density)
+    {
+        field_t f;
+        ref.reset();
+        for (std::size_t i = 0; i < bits; ++i)
+        {
+            if (rnd() % density != 0) continue;
+            f |= single<field_t>(i);
+            ref.set(i);
+        }
+        return f;
+    }
+
+    //the queries on one word against a loop over its bits, positions count from 1 and are 0 for no bit
+    template <typename field_t>
+    void check_queries(const std::uint64_t seed)
+    {
+        typedef bitfield_traits<field_t> traits;
+        typedef typename traits::word_t word_t;
+        constexpr unsigned int word_bits = 8 * sizeof(word_t);
+        test_random rnd(seed);
+        for (int round = 0; round < 2000; ++round)
+        {
+            //sparse, dense, empty and full words
+            std::uint64_t r = rnd();
+            if (round % 4 == 1) r &= rnd() & rnd();
+            if (round % 50 == 2) r = 0;
+            if (round % 50 == 3) r = ~std::uint64_t(0);
+            const word_t w = static_cast<word_t>(r), m = static_cast<word_t>(rnd() & rnd());
+            const field_t f = traits::to_field(w), mask = traits::to_field(m);
+            unsigned int count = 0, first = 0, last = 0;
+            for (unsigned int b = 0; b < word_bits; ++b)
+            {
+                if (((w >> b) & 1) == 0) continue;
+                ++count;
+                if (first == 0) first = b + 1;
+                last = b + 1;
+            }
+            TEST_CHECK(bitfield_count(f) == count);
+            TEST_CHECK(bitfield_first_set(f) == first);
+            TEST_CHECK(bitfield_last_set(f) == last);
+            TEST_CHECK(bitfield_any(f) == (w != 0));
+            TEST_CHECK(bitfield_none(f) == (w == 0));
+            TEST_CHECK(bitfield_any(f, mask) == ((w & m) != 0));
+            TEST_CHECK(bitfield_all(f, mask) == ((w & m) == m));
+            TEST_CHECK(bitfield_none(f, mask) == ((w & m) == 0));
+            //the bits come out one at a time, lowest first
+            unsigned int seen = 0;
+            word_t rest = w;
+            for (const auto bit : bitfield_each_set_bit(f))
+            {
+                const word_t b = traits::to_word(bit);
+                TEST_CHECK(b == static_cast<word_t>(rest & (~rest + 1)));
+                rest = static_cast<word_t>(rest & ~b);
+                ++seen;
+            }
+            TEST_CHECK(seen == count && rest == 0);
+        #ifdef _BITFIELD
+            TEST_CHECK(f.count() == count && f.first_set() == first && f.last_set() == last);
+            TEST_CHECK(f.any(mask) == bitfield_any(f, mask) && f.all(mask) == bitfield_all(f, mask) && f.none(mask) == bitfield_none(f, mask));
+        #endif
+        }
+    }
+
+    //expressions evaluated in one pass against the same expression on std::bitset
+    template <typename field_t, std::size_t bits>
+    void check_expressions(const std::uint64_t seed)
+    {
+        auto ref = [](const field_t& f) { return bits_of<bits>(f); };
+        test_random rnd(seed);
+        for (int round = 0; round < 50; ++round)
+        {
+            std::bitset<bits> ra, rb, rc, rd;
+            const field_t a = random_field<field_t>(rnd, ra, 2), b = random_field<field_t>(rnd, rb, 2);
+            const field_t c = random_field<field_t>(rnd, rc, 3), d = random_field<field_t>(rnd, rd, 5);
+            const std::bitset<bits> expected = ((ra & rb) | rc) ^ (rd & ~ra);
+            const field_t r = ((a & b) | c) ^ (d & ~a);
+            TEST_CHECK(ref(r) == expected);
+            TEST_CHECK((((a & b) | c) ^ (d & ~a)) == r && r == (((a & b) | c) ^ (d & ~a)));
+            TEST_CHECK((((a & b) | c) ^ (d & ~a)).count() == expected.count());
+            TEST_CHECK(((a & b) == nullptr) == (ra & rb).none() && bool(a & b) == (ra & rb).any() && !(a & b) == (ra & rb).none());
+            TEST_CHECK(ref(~(a | b)) == ~(ra | rb));
+            TEST_CHECK((a ^ a) == nullptr && (~(a | ~a)) == nullptr);
+            TEST_CHECK((a & b).any(c) == (ra & rb & rc).any() && (a | b).all(c) == ((rc & ~(ra | rb)).none()) && (a & b).none(c) == (ra & rb & rc).none());
+
+            std::size_t first = 0, last = 0, seen = 0;
+            for (std::size_t i = 0; i < bits; ++i)
+            {
+                if (!(ra & rc)[i]) continue;
+                if (first == 0) first = i + 1;
+                last = i + 1;
+            }
+            TEST_CHECK((a & c).first_set() == first && (a & c).last_set() == last);
+            for (const auto bit : (a & c).each_set_bit())
+            {
+                TEST_CHECK(((field_t(bit) & a) & c) == bit);
+                ++seen;
+            }
+            TEST_CHECK(seen == (ra & rc).count());
+
+            //the result may be an operand, every word is read before it is written
+            field_t t = a;
+            t = (t & b) | (c & ~t);
+            TEST_CHECK(ref(t) == ((ra & rb) | (rc & ~ra)));
+            t = a;
+            t |= ~b & c;
+            TEST_CHECK(ref(t) == (ra | (~rb & rc)));
+            t = a;
+            t &= b ^ c;
+            TEST_CHECK(ref(t) == (ra & (rb ^ rc)));
+            t = a;
+            t ^= ~t;
+            TEST_CHECK(ref(t).all());
+            //an expression shifts after it is evaluated
+            const unsigned int shift = static_cast<unsigned int>(rnd() % bits);
+            TEST_CHECK(ref((a & b) << shift) == ((ra & rb) << shift) && ref((a | b) >> shift) == ((ra | rb) >> shift));
+        }
+    }
+
+    template <typename field_t, std::size_t bits>
+    void check_wide_queries(const std::uint64_t seed)
+    {
+        test_random rnd(seed);
+        for (int round = 0; round < 200; ++round)
+        {
+            std::bitset<bits> rf, rm;
+            const field_t f = random_field<field_t>(rnd, rf, round % 3 == 0 ? 2 : 64 + round), mask = random_field<field_t>(rnd, rm, 97);
+            std::size_t first = 0, last = 0;
+            for (std::size_t i = 0; i < bits; ++i)
+            {
+                if (!rf[i]) continue;
+                if (first == 0) first = i + 1;
+                last = i + 1;
+            }
+            TEST_CHECK(f.count() == rf.count() && bitfield_count(f) == rf.count());
+            TEST_CHECK(f.first_set() == first && bitfield_first_set(f) == first);
+            TEST_CHECK(f.last_set() == last && bitfield_last_set(f) == last);
+            TEST_CHECK(bitfield_any(f) == rf.any() && bitfield_none(f) == rf.none());
+            TEST_CHECK(bitfield_any(f, mask) == (rf & rm).any());
+            TEST_CHECK(bitfield_all(f, mask) == ((rf & rm) == rm));
+            TEST_CHECK(bitfield_none(f, mask) == (rf & rm).none());
+            std::bitset<bits> seen;
+            std::size_t previous = 0;
+            bool in_order = true;
+            for (auto it = f.each_set_bit().begin(); it != f.each_set_bit().end(); ++it)
+            {
+                in_order = in_order && it.position() > previous;
+                previous = it.position();
+                seen.set(it.position() - 1);
+                TEST_CHECK(field_t(*it) == single<field_t>(it.position() - 1));
+            }
+            TEST_CHECK(in_order && seen == rf);
+        }
+    }
+
+    //the bits [offset, offset + width) of w, counting from 1 as the subfields do
+    template <typename word_t>
+    std::uint64_t bits_at(const word_t w, const unsigned int offset, const unsigned int width)
+    {
+        return (static_cast<std::uint64_t>(w) >> (offset - 1)) & (width == 64 ? ~std::uint64_t(0) : (std::uint64_t(1) << width) - 1);
+    }
+
+    //three way comparison of a and b as unsigned integers
+    template <std::size_t bits>
+    int compare(const std::bitset<bits>& a, const std::bitset<bits>& b)
+    {
+        for (std::size_t i = bits; i-- > 0;)
+            if (a[i] != b[i]) return a[i] ? 1 : -1;
+        return 0;
+    }
+
+    template <typename field_t, std::size_t bits>
+    void check_wide(const std::uint64_t seed)
+    {
+        auto ref = [](const field_t& f) { return bits_of<bits>(f); };
+        test_random rnd(seed);
+        for (int round = 0; round < 100; ++round)
+        {
+            std::bitset<bits> ra, rb;
+            const field_t a = random_field<field_t>(rnd, ra, 2), b = random_field<field_t>(rnd, rb, round % 7 + 2);
+            TEST_CHECK(ref(a) == ra);
+            field_t r = a;
+            r &= b;
+            TEST_CHECK(ref(r) == (ra & rb));
+            r = a;
+            r |= b;
+            TEST_CHECK(ref(r) == (ra | rb));
+            r = a;
+            r ^= b;
+            TEST_CHECK(ref(r) == (ra ^ rb));
+            TEST_CHECK(ref(~a) == ~ra);
+
+            //a random shift, and the ones that move whole words or cross the end
+            const unsigned int shifts[] = { 0, 1, 63, 64, 65, static_cast<unsigned int>(bits - 1), static_cast<unsigned int>(rnd() % bits) };
+            for (const unsigned int s : shifts)
+            {
+                if (s >= bits) continue;
+                TEST_CHECK(ref(a << s) == (ra << s));
+                TEST_CHECK(ref(a >> s) == (ra >> s));
+                r = a;
+                r <<= s;
+                TEST_CHECK(ref(r) == (ra << s));
+                r = a;
+                r >>= s;
+                TEST_CHECK(ref(r) == (ra >> s));
+            }
+
+            const int order = compare(ra, rb);
+            TEST_CHECK((a == b) == (order == 0));
+            TEST_CHECK((a != b) == (order != 0));
+            TEST_CHECK((a < b) == (order < 0));
+            TEST_CHECK((a <= b) == (order <= 0));
+            TEST_CHECK((a > b) == (order > 0));
+            TEST_CHECK((a >= b) == (order >= 0));
+            TEST_CHECK(a == a && !(a < a) && a >= a);
+            TEST_CHECK((a == nullptr) == ra.none());
+            TEST_CHECK((a != nullptr) == ra.any());
+        }
+        //the bits above the field stay clear through ~ and shifts
+        const field_t ones = ~field_t();
+        TEST_CHECK(ref(ones).all());
+        TEST_CHECK((ones >> static_cast<unsigned int>(bits - 1)) == single<field_t>(0));
+        TEST_CHECK((ones << static_cast<unsigned int>(bits - 1)) == single<field_t>(bits - 1));
+        TEST_CHECK(((ones << 1) >> 1) != ones);
+    }
+}
+
+TEST(wide_ops)
+{
+    check_wide<wide64, 64>(1);
+    check_wide<wide300, 300>(2);
+    check_wide<wide1024, 1024>(3);
+}
+
+TEST(wide_masks)
+{
+    wide300 f;
+    TEST_CHECK(f == nullptr);
+    f |= WIDE_LAST;
+    TEST_CHECK(f != nullptr && f == single<wide300>(299));
+    f |= WIDE_FIRST;
+    TEST_CHECK(f == WIDE_ENDS);
+    TEST_CHECK((f & WIDE_MIDDLE) == nullptr);
+    TEST_CHECK(WIDE_FIRST < f && WIDE_MIDDLE < WIDE_LAST);
+    f ^= WIDE_FIRST;
+    TEST_CHECK(f == WIDE_LAST);
+    f &= WIDE_MIDDLE;
+    TEST_CHECK(f == nullptr);
+    TEST_CHECK(sizeof(wide300) == 40 && sizeof(wide1024) == 128);
+    static_assert(std::is_trivially_copyable<wide300>::value, "wide fields are copied as their words");
+}
+
+TEST(expressions)
+{
+    check_expressions<wide64, 64>(13);
+    check_expressions<wide300, 300>(14);
+    check_expressions<wide1024, 1024>(15);
+    //masks and fields of the same field mix in an expression
+    const wide300 f = WIDE_FIRST | (WIDE_MIDDLE & ~WIDE_ENDS);
+    TEST_CHECK(f == (WIDE_FIRST | WIDE_MIDDLE) && (f ^ WIDE_FIRST) == WIDE_MIDDLE);
+}
+
+TEST(queries)
+{
+    check_queries<flags8>(5);
+    check_queries<flags16>(6);
+    check_queries<flags32>(7);
+    check_queries<status>(8);
+}
+
+TEST(wide_queries)
+{
+    check_wide_queries<wide64, 64>(9);
+    check_wide_queries<wide300, 300>(10);
+    check_wide_queries<wide1024, 1024>(11);
+    const wide300 empty;
+    TEST_CHECK(empty.each_set_bit().begin() == empty.each_set_bit().end());
+    TEST_CHECK(empty.count() == 0 && empty.first_set() == 0 && empty.last_set() == 0);
+}
+
+TEST(subfields)
+{
+    typedef bitfield_traits<header> traits;
+    test_random rnd(12);
+    for (int round = 0; round < 2000; ++round)
+    {
+        const std::uint64_t w = rnd();
+        const header h = traits::to_field(w);
+        TEST_CHECK(PRIORITY.get(h) == bits_at(w, 2, 3));
+        TEST_CHECK(static_cast<std::uint64_t>(STATE.get(h)) == bits_at(w, 5, 4));
+        TEST_CHECK(URGENT.get(h) == (bits_at(w, 9, 1) != 0));
+        TEST_CHECK(LENGTH.get(h) == bits_at(w, 33, 32));
+        const auto [priority, state] = bitfield_get(h, PRIORITY, STATE);
+        TEST_CHECK(priority == PRIORITY.get(h) && state == STATE.get(h));
+
+        //set and with replace the subfield and keep every other bit
+        const unsigned int p = static_cast<unsigned int>(rnd() % 8);
+        const std::uint64_t length = rnd() >> 32;
+        header s = h;
+        PRIORITY.set(s, p);
+        TEST_CHECK(traits::to_word(s) == ((w & ~(std::uint64_t(7) << 1)) | (std::uint64_t(p) << 1)));
+        TEST_CHECK(traits::to_word(LENGTH.with(h, length)) == ((w & 0xFFFFFFFFull) | (length << 32)));
+        s = h;
+        bitfield_set(s, PRIORITY(p), STATE(job_state::failed), URGENT(false), LENGTH(length));
+        const std::uint64_t cleared = w & ~(std::uint64_t(0xFF) << 1) & 0xFFFFFFFFull;
+        TEST_CHECK(traits::to_word(s) == (cleared | (std::uint64_t(p) << 1) | (std::uint64_t(3) << 4) | (length << 32)));
+        TEST_CHECK((s & VALID) == (h & VALID));
+
+        //packed - the subfields next to each other in the order of their offsets, whatever order they are named in
+        const std::uint64_t packed = bitfield_extract_packed(h, LENGTH, STATE, PRIORITY);
+        TEST_CHECK(packed == (bits_at(w, 2, 3) | (bits_at(w, 5, 4) << 3) | (bits_at(w, 33, 32) << 7)));
+        header d = traits::to_field(~w);
+        bitfield_deposit_packed(d, packed, PRIORITY, STATE, LENGTH);
+        TEST_CHECK(PRIORITY.get(d) == PRIORITY.get(h) && STATE.get(d) == STATE.get(h) && LENGTH.get(d) == LENGTH.get(h));
+        TEST_CHECK(URGENT.get(d) == !URGENT.get(h));
+
+        //a 16 bit word has no PEXT/PDEP form
+        typedef bitfield_traits<flags16> traits16;
+        const std::uint16_t w16 = static_cast<std::uint16_t>(w);
+        const flags16 f = traits16::to_field(w16);
+        TEST_CHECK(LOW.get(f) == bits_at(w16, 1, 5) && HIGH.get(f) == bits_at(w16, 10, 7));
+        const std::uint16_t packed16 = bitfield_extract_packed(f, HIGH, LOW);
+        TEST_CHECK(packed16 == (bits_at(w16, 1, 5) | (bits_at(w16, 10, 7) << 5)));
+        flags16 g = flags16();
+        bitfield_deposit_packed(g, packed16, LOW, HIGH);
+        TEST_CHECK(traits16::to_word(g) == (w16 & 0xFE1F));
+    }
+}
+
+TEST(atomic_ops)
+{
+    //every operation against the same operation on a plain word
+    test_random rnd(4);
+    atomic_status a;
+    std::uint64_t ref = 0;
+    TEST_CHECK(a.load() == 0);
+    for (int round = 0; round < 1000; ++round)
+    {
+        const std::uint64_t m = rnd() & rnd();
+        const status mask = status_of(m);
+        switch (rnd() % 7)
+        {
+        case 0: TEST_CHECK(word_of(a.fetch_or(mask)) == ref); ref |= m; break;
+        case 1: TEST_CHECK(word_of(a.fetch_and(mask, std::memory_order_relaxed)) == ref); ref &= m; break;
+        case 2: TEST_CHECK(word_of(a.fetch_xor(mask, std::memory_order_acq_rel)) == ref); ref ^= m; break;
+        case 3: TEST_CHECK(a.test_and_set(mask) == ((ref & m) != 0)); ref |= m; break;
+        case 4: TEST_CHECK(a.test_and_clear(mask) == ((ref & m) != 0)); ref &= ~m; break;
+        case 5: TEST_CHECK(word_of(a.exchange(mask)) == ref); ref = m; break;
+        default: TEST_CHECK(word_of(a.update([m](const status s) { return status_of(word_of(s) ^ (m >> 1)); })) == ref); ref ^= m >> 1; break;
+        }
+        TEST_CHECK(word_of(a.load(std::memory_order_acquire)) == ref);
+        TEST_CHECK(a.test(mask) == ((ref & m) != 0));
+    }
+    status expected = status_of(ref ^ 1);
+    TEST_CHECK(!a.compare_exchange_strong(expected, READY, std::memory_order_acq_rel, std::memory_order_acquire));
+    TEST_CHECK(word_of(expected) == ref);
+    TEST_CHECK(a.compare_exchange_strong(expected, READY, std::memory_order_acq_rel, std::memory_order_acquire));
+    TEST_CHECK(a.load() == READY);
+    a.store(DONE | FAILED);
+    TEST_CHECK(a.test(FAILED) && !a.test(READY));
+    atomic_status b(FAILED);
+    TEST_CHECK(b.load() == FAILED);
+}
+
+TEST(atomic_threads)
+{
+    //each thread owns one bit and toggles it an even number of times, the bits must end as they started,
+    //then each thread claims the lowest clear bit with update, and every thread must get a different one
+    constexpr unsigned int threads = 8;
+    atomic_status a(FAILED);
+    std::vector<std::thread> pool;
+    for (unsigned int t = 0; t < threads; ++t)
+        pool.emplace_back([&a, t] { for (int i = 0; i < 20000; ++i) a.fetch_xor(status_of(std::uint64_t(1) << t), std::memory_order_relaxed); });
+    for (std::thread& t : pool) t.join();
+    TEST_CHECK(a.load() == FAILED);
+    pool.clear();
+    std::uint64_t claimed[threads] = {};
+    for (unsigned int t = 0; t < threads; ++t)
+    {
+        pool.emplace_back([&a, &claimed, t]
+        {
+            const std::uint64_t before = word_of(a.update([](const status s) { return status_of(word_of(s) | (word_of(s) + 1)); }, std::memory_order_acq_rel));
+            claimed[t] = ~before & (before + 1);
+        });
+    }
+    for (std::thread& t : pool) t.join();
+    std::uint64_t all = 0;
+    for (const std::uint64_t c : claimed)
+    {
+        TEST_CHECK(c != 0 && (all & c) == 0);
+        all |= c;
+    }
+    TEST_CHECK(a.load() == status_of(all | word_of(FAILED)));
+
+    //the waiter sees the field once DONE is set, and not before
+    atomic_status flag;
+    std::atomic<bool> woke(false);
+    status seen = status();
+    std::thread waiter([&] { seen = flag.wait_for_any(DONE | READY, std::memory_order_acquire); woke.store(true); });
+    flag.fetch_or(FAILED, std::memory_order_release);
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    TEST_CHECK(!woke.load());
+    flag.fetch_or(DONE, std::memory_order_release);
+    waiter.join();
+    TEST_CHECK(woke.load() && seen == (DONE | FAILED));
+}
@@ -0,0 +1,163 @@
+/*Copyright 2017 Jonathan Campbell
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.*/
+//checked_bit_file - records saved and mapped back, and the files open rejects
+#include "test.h"
+#include "../Bitfile.h"
+#include <string>
+
+//the files go to the working directory, ctest runs the tests in the build directory
+BIT_FIELD(std::uint32_t, perm);
+BIT_MASK(perm, READ, 1);
+BIT_MASK(perm, WRITE, 2);
+BIT_MASK(perm, EXEC, 32);
+BIT_FIELD(std::uint32_t, other);
+BIT_FIELD(std::uint16_t, narrow);
+#ifdef _BITFIELD
+bitfield_unique_id ui_perm;
+bitfield_unique_id ui_other;
+bitfield_unique_id ui_narrow;
+#endif
+BIT_FILE(perm, perm_file, "test.perm");
+BIT_FILE(other, other_file, "test.other");
+//the name is the identity of the file, not the type
+BIT_FILE(other, perm_as_other_file, "test.perm");
+BIT_FILE(narrow, narrow_file, "test.perm");
+
+namespace
+{
+    std::string path(const char* name) { return std::string("test_bitfile_") + test_mode + "_" + name + ".bin"; }
+
+    bool exists(const std::string& p)
+    {
+        std::FILE* const f = std::fopen(p.c_str(), "rb");
+        if (f != nullptr) std::fclose(f);
+        return f != nullptr;
+    }
+
+    //overwrites the bytes at offset of the file with value
+    template <typename T>
+    void patch(const std::string& p, const long offset, const T value)
+    {
+        std::FILE* const f = std::fopen(p.c_str(), "r+b");
+        if (f == nullptr) return;
+        std::fseek(f, offset, SEEK_SET);
+        std::fwrite(&value, sizeof(value), 1, f);
+        std::fclose(f);
+    }
+
+    std::vector<perm> records(const std::size_t n, const std::uint64_t seed)
+    {
+        test_random rnd(seed);
+        std::vector<perm> v(n);
+        for (perm& r : v) r = bitfield_traits<perm>::to_field(static_cast<std::uint32_t>(rnd()));
+        return v;
+    }
+
+    bool same(const perm_file& f, const std::vector<perm>& v)
+    {
+        if (f.size() != v.size()) return false;
+        for (std::size_t i = 0; i < v.size(); ++i)
+            if (f[i] != v[i]) return false;
+        return true;
+    }
+}
+
+TEST(file_round_trip)
+{
+    const std::string p = path("round_trip");
+    for (const std::size_t n : { std::size_t(0), std::size_t(1), std::size_t(1000), std::size_t(100000) })
+    {
+        const std::vector<perm> v = records(n, n + 1);
+        TEST_CHECK(perm_file::save(p.c_str(), v.data(), n) == bitfield_file_status::ok);
+        TEST_CHECK(!exists(p + ".tmp"));
+        perm_file f;
+        TEST_CHECK(f.open(p.c_str()) == bitfield_file_status::ok);
+        TEST_CHECK(f.is_open() && f.mode() == bitfield_file_mode::read_only && f.empty() == (n == 0));
+        TEST_CHECK(same(f, v));
+        TEST_CHECK(n == 0 || reinterpret_cast<std::uintptr_t>(f.data()) % 64 == 0);
+        std::size_t readable = 0, expected = 0;
+        for (const perm& r : f) readable += (r & READ) != 0;
+        for (const perm& r : v) expected += (r & READ) != 0;
+        TEST_CHECK(readable == expected);
+        perm_file moved = std::move(f);
+        TEST_CHECK(!f.is_open() && moved.is_open() && same(moved, v));
+        moved.close();
+        TEST_CHECK(!moved.is_open() && moved.data() == nullptr);
+    }
+
+    //a copy-on-write mapping changes its own pages, never the file
+    const std::vector<perm> v = records(500, 7);
+    TEST_CHECK(perm_file::save(p.c_str(), v.data(), v.size()) == bitfield_file_status::ok);
+    perm_file cow, read;
+    TEST_CHECK(cow.open(p.c_str(), bitfield_file_mode::copy_on_write) == bitfield_file_status::ok);
+    cow.mutable_data()[0] = EXEC;
+    cow.mutable_data()[499] = WRITE;
+    TEST_CHECK(cow[0] == EXEC && cow[499] == WRITE);
+    TEST_CHECK(read.open(p.c_str()) == bitfield_file_status::ok && same(read, v));
+    cow.close();
+    read.close();
+
+    //the same name opens the file whatever the type is called
+    perm_as_other_file renamed;
+    TEST_CHECK(renamed.open(p.c_str()) == bitfield_file_status::ok && renamed.size() == v.size());
+    std::remove(p.c_str());
+}
+
+TEST(file_rejects)
+{
+    const std::string p = path("rejects");
+    const std::vector<perm> v = records(100, 3);
+    TEST_CHECK(perm_file::save(p.c_str(), v.data(), v.size()) == bitfield_file_status::ok);
+    perm_file f;
+    other_file o;
+    TEST_CHECK(o.open(p.c_str()) == bitfield_file_status::wrong_type && !o.is_open());
+    narrow_file w;
+    TEST_CHECK(w.open(p.c_str()) == bitfield_file_status::wrong_word_size && !w.is_open());
+    TEST_CHECK(f.open(path("missing").c_str()) == bitfield_file_status::cannot_open);
+
+    //a count past the end of the file
+    patch(p, 32, std::uint64_t(101));
+    TEST_CHECK(f.open(p.c_str()) == bitfield_file_status::not_a_bitfield_file && !f.is_open());
+    patch(p, 32, std::uint64_t(100));
+    TEST_CHECK(f.open(p.c_str()) == bitfield_file_status::ok);
+    f.close();
+    patch(p, 12, std::uint32_t(0x04030201));
+    TEST_CHECK(f.open(p.c_str()) == bitfield_file_status::wrong_byte_order);
+    patch(p, 8, std::uint32_t(2));
+    TEST_CHECK(f.open(p.c_str()) == bitfield_file_status::not_a_bitfield_file);
+    patch(p, 0, 'X');
+    TEST_CHECK(f.open(p.c_str()) == bitfield_file_status::not_a_bitfield_file);
+
+    //shorter than a header
+    std::FILE* const t = std::fopen(p.c_str(), "wb");
+    if (t != nullptr)
+    {
+        std::fwrite("BITFIELD", 1, 8, t);
+        std::fclose(t);
+    }
+    TEST_CHECK(f.open(p.c_str()) == bitfield_file_status::not_a_bitfield_file);
+
+    //a failed open closes the file mapped before
+    TEST_CHECK(perm_file::save(p.c_str(), v.data(), v.size()) == bitfield_file_status::ok);
+    TEST_CHECK(f.open(p.c_str()) == bitfield_file_status::ok);
+    TEST_CHECK(f.open(path("missing").c_str()) == bitfield_file_status::cannot_open && !f.is_open());
+
+    //a save that can't write leaves the old file as it was
+    const std::string blocked = path("no_such_directory/x");
+    TEST_CHECK(perm_file::save(blocked.c_str(), v.data(), v.size()) == bitfield_file_status::cannot_open);
+    TEST_CHECK(!exists(blocked + ".tmp"));
+    TEST_CHECK(f.open(p.c_str()) == bitfield_file_status::ok && same(f, v));
+    f.close();
+    std::remove(p.c_str());
+}
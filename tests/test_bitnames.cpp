@@ -0,0 +1,137 @@
+/*Copyright 2017 Jonathan Campbell
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.*/
+//checked_bit_names - formatting checked against a loop over the masks, and parsing back what was formatted
+#include "test.h"
+#include "../Bitnames.h"
+#include <string>
+
+BIT_FIELD(std::uint8_t, perm);
+BIT_FIELD(std::uint64_t, wide_perm);
+#ifdef _BITFIELD
+bitfield_unique_id ui_perm;
+bitfield_unique_id ui_wide_perm;
+#endif
+BIT_MASK(perm, READ, 1);
+BIT_MASK(perm, WRITE, 2);
+BIT_MASK(perm, EXEC, 3);
+INT_BIT_MASK(perm, RWX, 7);
+namespace perm_extra
+{
+    BIT_MASK(perm, HIDDEN, 8);
+}
+//RWX first, so it is written rather than its three bits
+BIT_NAMES(perm, perm_names, RWX, READ, WRITE, EXEC, perm_extra::HIDDEN);
+BIT_MASK(wide_perm, W1, 1);
+BIT_MASK(wide_perm, W2, 2);
+BIT_MASK(wide_perm, W17, 17);
+BIT_MASK(wide_perm, W33, 33);
+BIT_MASK(wide_perm, W64, 64);
+INT_BIT_MASK(wide_perm, W_LOW, 0xFF00);
+BIT_NAMES(wide_perm, wide_names, W_LOW, W1, W2, W17, W33, W64);
+struct perm_holder
+{
+    BIT_NAMES(perm, names, READ, WRITE);
+};
+
+static_assert(perm_names.size() == 5 && perm_names.label(4) == "HIDDEN", "labels drop the namespace");
+static_assert(perm_names.position(1) == 1 && perm_names.position(4) == 8 && perm_names.position(0) == 0, "RWX has no position");
+static_assert(perm_names.label_of(WRITE) == "WRITE" && perm_names.label_of(perm_holder::names.mask(0)) == "READ", "");
+static_assert(*perm_names.parse("READ | EXEC") == (READ | EXEC), "parse is constexpr");
+static_assert(!perm_names.parse("READ|NOPE") && !perm_names.parse("") && !perm_names.parse("READ|"), "");
+
+namespace
+{
+    //the text format_to writes, built the slow way - each mask in list order, then the bits left in hex
+    template <typename names_t>
+    std::string reference(const names_t& names, const std::uint64_t w)
+    {
+        if (w == 0) return "0";
+        std::string text;
+        std::uint64_t rest = w;
+        for (std::size_t i = 0; i < names.size(); ++i)
+        {
+            const std::uint64_t m = static_cast<std::uint64_t>(bitfield_traits<typename names_t::field_t>::to_word(names.mask(i)));
+            if (m == 0 || (rest & m) != m) continue;
+            if (!text.empty()) text += '|';
+            text += std::string(names.label(i));
+            rest &= ~m;
+        }
+        if (rest != 0)
+        {
+            char hex[24];
+            std::snprintf(hex, sizeof(hex), "0x%llX", static_cast<unsigned long long>(rest));
+            if (!text.empty()) text += '|';
+            text += hex;
+        }
+        return text;
+    }
+
+    template <typename names_t>
+    std::string format(const names_t& names, const typename names_t::field_t& f)
+    {
+        char text[128];
+        char* const end = names.format_to(text, f);
+        return std::string(text, end);
+    }
+
+    //formats w, checks the text against the reference and the length bound, and parses it back
+    template <typename names_t>
+    bool round_trip(const names_t& names, const std::uint64_t w)
+    {
+        typedef typename names_t::traits traits;
+        const typename names_t::field_t f = traits::to_field(static_cast<typename names_t::word_t>(w));
+        const std::string text = format(names, f);
+        if (text != reference(names, w) || text.size() > names.max_length()) return false;
+        const auto back = names.parse(text);
+        return back && static_cast<std::uint64_t>(traits::to_word(*back)) == w;
+    }
+
+    typedef bitfield_traits<perm> perm_traits;
+    perm perm_of(const std::uint8_t w) { return perm_traits::to_field(w); }
+}
+
+TEST(names_format)
+{
+    TEST_CHECK(format(perm_names, perm_of(3)) == "READ|WRITE");
+    TEST_CHECK(format(perm_names, perm_of(7)) == "RWX");
+    TEST_CHECK(format(perm_names, perm_of(0x8D)) == "READ|EXEC|HIDDEN|0x8");
+    TEST_CHECK(format(perm_names, perm_of(0)) == "0");
+    TEST_CHECK(format(wide_names, bitfield_traits<wide_perm>::to_field(~std::uint64_t(0))) == "W_LOW|W1|W2|W17|W33|W64|0x7FFFFFFEFFFE00FC");
+    TEST_CHECK(format(perm_holder::names, perm_of(6)) == "WRITE|0x4");
+}
+
+TEST(names_round_trip)
+{
+    for (std::uint64_t w = 0; w < 256; ++w) TEST_CHECK(round_trip(perm_names, w));
+    test_random rnd;
+    for (int i = 0; i < 10000; ++i)
+    {
+        //sparse words too, so the labels are more often alone
+        const std::uint64_t w = rnd();
+        TEST_CHECK(round_trip(wide_names, w) && round_trip(wide_names, w & rnd() & rnd()));
+    }
+    TEST_CHECK(round_trip(wide_names, ~std::uint64_t(0)) && round_trip(wide_names, std::uint64_t(1) << 63));
+}
+
+TEST(names_parse)
+{
+    const auto value = [](const std::string& text) { const auto f = perm_names.parse(text); return f ? static_cast<int>(perm_traits::to_word(*f)) : -1; };
+    TEST_CHECK(value(" READ |\tWRITE ") == 3);
+    TEST_CHECK(value("0x10|READ") == 0x11 && value("0X1f") == 0x1F && value("0") == 0);
+    TEST_CHECK(value("RWX|READ") == 7 && value("HIDDEN") == 0x80);
+    TEST_CHECK(value("0x100") == -1 && value("0x") == -1 && value("0xG") == -1);
+    TEST_CHECK(value("READX") == -1 && value("REA") == -1 && value("read") == -1);
+    TEST_CHECK(value("|READ") == -1 && value("READ||WRITE") == -1 && value(" ") == -1);
+    TEST_CHECK(wide_names.parse("W64|0xFFFFFFFFFFFFFFFF") && !wide_names.parse("0x10000000000000000"));
+}
@@ -0,0 +1,149 @@
+/*Copyright 2017 Jonathan Campbell
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.*/
+//checked_sparse_bit_vector checked against std::set, in each of its chunk forms
+#include "test.h"
+#include "../Bitsparse.h"
+#include <algorithm>
+#include <set>
+
+BIT_FIELD(std::uint32_t, id);
+#ifdef _BITFIELD
+bitfield_unique_id ui_id;
+#endif
+SPARSE_BIT_VECTOR(id, id_set);
+
+namespace
+{
+    typedef std::set<std::uint32_t> reference;
+
+    //indices over the whole space, a dense stretch, one chunk and the last chunk, so chunks take every form
+    std::uint32_t pick(test_random& rnd)
+    {
+        switch (rnd() % 4)
+        {
+        case 0: return static_cast<std::uint32_t>(rnd());
+        case 1: return static_cast<std::uint32_t>(rnd() % 200000);
+        case 2: return 65536 * 3 + static_cast<std::uint32_t>(rnd() % 65536);
+        default: return 0xFFFF0000u + static_cast<std::uint32_t>(rnd() % 65536);
+        }
+    }
+
+    //random bits, sometimes a range and sometimes cleared again, into both the vector and the reference
+    void build(id_set& s, reference& r, test_random& rnd)
+    {
+        const std::size_t n = rnd() % 3 == 0 ? 20000 : rnd() % 300;
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            const std::uint32_t v = pick(rnd);
+            s.set(v);
+            r.insert(v);
+        }
+        if (rnd() % 2 != 0)
+        {
+            const std::uint64_t first = pick(rnd), last = std::min<std::uint64_t>(first + rnd() % 300000, std::uint64_t(1) << 32);
+            s.set_range(first, last);
+            for (std::uint64_t v = first; v < last; ++v) r.insert(static_cast<std::uint32_t>(v));
+        }
+        for (std::size_t i = 0; i < n / 3; ++i)
+        {
+            const reference::const_iterator near = r.lower_bound(pick(rnd) % 200000);
+            const std::uint32_t v = rnd() % 2 != 0 || near == r.end() ? pick(rnd) : *near;
+            s.clear(v);
+            r.erase(v);
+        }
+        if (rnd() % 2 != 0) s.optimize();
+    }
+
+    bool same(const id_set& s, const reference& r, test_random& rnd)
+    {
+        if (s.count() != r.size() || s.any() != !r.empty()) return false;
+        if (!std::equal(s.begin(), s.end(), r.begin(), r.end())) return false;
+        if (s.any() && s.find_first() != *r.begin()) return false;
+        for (const std::uint32_t v : r)
+            if (!s.test(v)) return false;
+        for (int i = 0; i < 200; ++i)
+        {
+            const std::uint32_t v = pick(rnd);
+            if (s.test(v) != (r.count(v) != 0)) return false;
+        }
+        return true;
+    }
+}
+
+TEST(sparse_bits)
+{
+    test_random rnd(5);
+    for (int round = 0; round < 20; ++round)
+    {
+        id_set s;
+        reference r;
+        build(s, r, rnd);
+        TEST_CHECK(same(s, r, rnd));
+        id_set o = s;
+        o.optimize();
+        TEST_CHECK(o == s && same(o, r, rnd));
+        const bool had = s.test(12345);
+        o.set(12345);
+        TEST_CHECK((o == s) == had);
+        o.clear_all();
+        TEST_CHECK(o.none() && o.count() == 0 && o.begin() == o.end());
+    }
+
+    //the whole index space is one run per chunk
+    id_set full;
+    full.set_range(0, std::uint64_t(1) << 32);
+    TEST_CHECK(full.count() == (std::size_t(1) << 32) && full.memory_usage() < (std::size_t(8) << 20));
+    full.clear(7);
+    full.clear(0xFFFFFFFFu);
+    TEST_CHECK(!full.test(7) && full.test(8) && !full.test(0xFFFFFFFFu) && full.count() == (std::size_t(1) << 32) - 2);
+
+    //a few random bits stay arrays, far smaller than the 512MB of a dense vector
+    id_set few;
+    for (int i = 0; i < 5000; ++i) few.set(static_cast<std::uint32_t>(rnd()));
+    TEST_CHECK(few.memory_usage() < (std::size_t(1) << 20));
+}
+
+TEST(sparse_ops)
+{
+    test_random rnd(7);
+    for (int round = 0; round < 20; ++round)
+    {
+        id_set a, b;
+        reference ra, rb;
+        build(a, ra, rnd);
+        build(b, rb, rnd);
+        reference both, either = ra, only;
+        for (const std::uint32_t v : ra) (rb.count(v) != 0 ? both : only).insert(v);
+        either.insert(rb.begin(), rb.end());
+
+        id_set c = a;
+        c.and_with(b);
+        TEST_CHECK(same(c, both, rnd));
+        c = a;
+        c.or_with(b);
+        TEST_CHECK(same(c, either, rnd));
+        c.optimize();
+        TEST_CHECK(same(c, either, rnd));
+        c = a;
+        c.and_not_with(b);
+        TEST_CHECK(same(c, only, rnd));
+        c.and_with(b);
+        TEST_CHECK(c.none());
+        c = a;
+        c.and_with(c);
+        TEST_CHECK(c == a);
+        c.swap(b);
+        TEST_CHECK(same(c, rb, rnd) && same(b, ra, rnd));
+    }
+}
@@ -0,0 +1,217 @@
+/*Copyright 2017 Jonathan Campbell
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.*/
+//checked_bit_vector and its expressions checked against std::vector<bool>
+#include "test.h"
+#include "../Bitvector.h"
+#include <cstdint>
+
+BIT_FIELD(std::uint64_t, entity);
+#ifdef _BITFIELD
+bitfield_unique_id ui_entity;
+#endif
+BIT_VECTOR(entity, entity_vector);
+
+namespace
+{
+    typedef std::vector<bool> reference;
+
+    bool same(const entity_vector& v, const reference& r)
+    {
+        if (v.size() != r.size()) return false;
+        for (std::size_t i = 0; i < r.size(); ++i)
+            if (v.test(i) != r[i]) return false;
+        return true;
+    }
+    std::size_t count(const reference& r)
+    {
+        std::size_t n = 0;
+        for (const bool b : r) n += b;
+        return n;
+    }
+    //a vector and its reference with about one bit in density set
+    void randomize(test_random& rnd, entity_vector& v, reference& r, const unsigned int density)
+    {
+        for (std::size_t i = 0; i < r.size(); ++i)
+        {
+            r[i] = rnd() % density == 0;
+            if (r[i]) v.set(i); else v.clear(i);
+        }
+    }
+}
+
+TEST(vector_bits)
+{
+    test_random rnd(1);
+    for (int round = 0; round < 100; ++round)
+    {
+        //sizes on and around the word and cache line boundaries, and random ones
+        const std::size_t sizes[] = { 0, 1, 63, 64, 65, 511, 512, 513 };
+        const std::size_t n = round < 8 ? sizes[round] : static_cast<std::size_t>(rnd() % 5000);
+        entity_vector v(n);
+        reference r(n);
+        TEST_CHECK(v.size() == n && v.capacity() >= n && v.none() && v.count() == 0);
+        TEST_CHECK(n == 0 || reinterpret_cast<std::uintptr_t>(v.data()) % 64 == 0);
+        for (int k = 0; k < 20 && n != 0; ++k)
+        {
+            const std::size_t first = static_cast<std::size_t>(rnd() % n), last = first + static_cast<std::size_t>(rnd() % (n - first + 1));
+            const bool value = (rnd() & 1) != 0;
+            if (value) v.set_range(first, last); else v.clear_range(first, last);
+            for (std::size_t i = first; i < last; ++i) r[i] = value;
+        }
+        for (int k = 0; k < 50 && n != 0; ++k)
+        {
+            const std::size_t i = static_cast<std::size_t>(rnd() % n);
+            v.flip(i);
+            r[i] = !r[i];
+        }
+        TEST_CHECK(same(v, r));
+        TEST_CHECK(v.count() == count(r) && v.any() == (count(r) != 0));
+
+        //find_first/find_next visit the set bits in order
+        std::size_t expected = 0;
+        while (expected < n && !r[expected]) ++expected;
+        for (std::size_t pos = v.find_first(); pos != entity_vector::npos; pos = v.find_next(pos + 1))
+        {
+            TEST_CHECK(pos == expected);
+            ++expected;
+            while (expected < n && !r[expected]) ++expected;
+        }
+        TEST_CHECK(expected == n);
+        TEST_CHECK(v.find_next(n) == entity_vector::npos);
+
+        entity_vector all(n, true);
+        TEST_CHECK(all.count() == n);
+        all.clear_all();
+        TEST_CHECK(all.none());
+        all.set_all();
+        TEST_CHECK(all.count() == n);
+    }
+}
+
+TEST(vector_resize)
+{
+    test_random rnd(2);
+    entity_vector v;
+    reference r;
+    TEST_CHECK(v.empty() && v.data() == nullptr);
+    //shrinking an empty vector has nothing to clear
+    v.resize(0);
+    TEST_CHECK(v.empty());
+    for (int round = 0; round < 300; ++round)
+    {
+        const std::size_t n = static_cast<std::size_t>(rnd() % (round < 150 ? 200 : 6000));
+        const bool value = (rnd() & 1) != 0;
+        v.resize(n, value);
+        r.resize(n, value);
+        TEST_CHECK(same(v, r) && v.count() == count(r));
+        if (round % 3 == 0) randomize(rnd, v, r, 3);
+        //the bits dropped by a shrink read as cleared when the vector grows again
+        const std::size_t shrunk = n / 2;
+        v.resize(shrunk);
+        r.resize(shrunk);
+        v.resize(n);
+        r.resize(n, false);
+        TEST_CHECK(same(v, r) && v.count() == count(r));
+    }
+    v.reserve(100000);
+    TEST_CHECK(v.capacity() >= 100000 && same(v, r));
+}
+
+TEST(vector_ops)
+{
+    test_random rnd(3);
+    for (int round = 0; round < 50; ++round)
+    {
+        const std::size_t n = static_cast<std::size_t>(rnd() % 3000);
+        entity_vector a(n), b(n);
+        reference ra(n), rb(n);
+        randomize(rnd, a, ra, 2);
+        randomize(rnd, b, rb, 3);
+        entity_vector r = a;
+        TEST_CHECK(r == a && (n == 0 || r.data() != a.data()));
+        reference expected = ra;
+        r.and_with(b);
+        for (std::size_t i = 0; i < n; ++i) expected[i] = ra[i] && rb[i];
+        TEST_CHECK(same(r, expected));
+        r = a;
+        r.or_with(b);
+        for (std::size_t i = 0; i < n; ++i) expected[i] = ra[i] || rb[i];
+        TEST_CHECK(same(r, expected));
+        r = a;
+        r.xor_with(b);
+        for (std::size_t i = 0; i < n; ++i) expected[i] = ra[i] != rb[i];
+        TEST_CHECK(same(r, expected));
+        r = a;
+        r.and_not_with(b);
+        for (std::size_t i = 0; i < n; ++i) expected[i] = ra[i] && !rb[i];
+        TEST_CHECK(same(r, expected));
+        TEST_CHECK((a == b) == (ra == rb));
+        TEST_CHECK(a != entity_vector(n + 1));
+
+        entity_vector moved = std::move(r);
+        TEST_CHECK(same(moved, expected) && r.size() == 0);
+        moved.swap(a);
+        TEST_CHECK(same(moved, ra) && same(a, expected));
+    }
+}
+
+TEST(vector_expressions)
+{
+    test_random rnd(4);
+    for (int round = 0; round < 50; ++round)
+    {
+        const std::size_t n = static_cast<std::size_t>(rnd() % 5000);
+        entity_vector a(n), b(n), c(n), d(n);
+        reference ra(n), rb(n), rc(n), rd(n), expected(n);
+        randomize(rnd, a, ra, 2);
+        randomize(rnd, b, rb, 2);
+        randomize(rnd, c, rc, 3);
+        randomize(rnd, d, rd, 5);
+        std::size_t ones = 0;
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            expected[i] = ((ra[i] && rb[i]) || rc[i]) != (rd[i] && !ra[i]);
+            ones += expected[i];
+        }
+        //built from the expression, assigned to a vector of another size and to one of the same size
+        const entity_vector r = ((a & b) | c) ^ (d & ~a);
+        TEST_CHECK(same(r, expected));
+        entity_vector sized(n + 7);
+        sized = ((a & b) | c) ^ (d & ~a);
+        TEST_CHECK(same(sized, expected));
+        entity_vector same_size(n);
+        const std::uint64_t* storage = same_size.data();
+        same_size = ((a & b) | c) ^ (d & ~a);
+        TEST_CHECK(same(same_size, expected) && same_size.data() == storage);
+        TEST_CHECK((((a & b) | c) ^ (d & ~a)).count() == ones);
+        TEST_CHECK(r == (((a & b) | c) ^ (d & ~a)) && (((a & b) | c) ^ (d & ~a)) == r);
+        TEST_CHECK((~a).count() == n - a.count());
+        TEST_CHECK((a ^ a) == nullptr && (~(a | ~a)) == nullptr);
+        TEST_CHECK(entity_vector(n + 1) != (a & b));
+
+        //the vector itself in the expression, and the compound forms against the in-place operations
+        entity_vector t = a, u = a;
+        t = (t & b) | (c & ~t);
+        for (std::size_t i = 0; i < n; ++i) expected[i] = (ra[i] && rb[i]) || (rc[i] && !ra[i]);
+        TEST_CHECK(same(t, expected));
+        t = a;
+        t &= ~b;
+        u.and_not_with(b);
+        TEST_CHECK(t == u);
+        t |= a & b;
+        TEST_CHECK(t == a);
+        t ^= ~a;
+        TEST_CHECK(t.count() == n);
+    }
+}
@@ -0,0 +1,179 @@
+/*Copyright 2017 Jonathan Campbell
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.*/
+//bitfield_instrument - the counts of set, clear and test accesses against the bits each operation changes
+#include "test.h"
+#include "../Bitfield.h"
+#include <cstring>
+#include <string>
+#include <thread>
+
+//The checked and plain targets check that the operations give the same bits, the instrumented target, built with
+//_BITFIELD_INSTRUMENT, also checks the counts. Each test resets the counts of its own field type first.
+BIT_FIELD(std::uint8_t, perm);
+BIT_MASK(perm, READ, 1);
+BIT_MASK(perm, WRITE, 2);
+BIT_MASK(perm, EXEC, 3);
+BIT_MASKS(perm, RW) = READ | WRITE;
+struct perm_holder
+{
+    BIT_MASK(perm, HIDDEN, 8);
+};
+#ifdef _BITFIELD
+bitfield_unique_id ui_perm;
+#endif
+
+namespace
+{
+    typedef bitfield_traits<perm> traits;
+    std::uint8_t word_of(const perm p) { return traits::to_word(p); }
+
+    perm local_mask()
+    {
+        BIT_MASK(perm, LOCAL, 7);
+        perm p = perm();
+        p |= LOCAL;
+        return p;
+    }
+
+#ifdef _BITFIELD_INSTRUMENT
+    typedef bitfield_instrument<perm> instrument;
+    typedef instrument::counts_t counts_t;
+
+    //set, clear and test counts of bit pos, numbered from 1
+    bool counted(const counts_t& c, const unsigned int pos, const std::uint64_t set, const std::uint64_t clear, const std::uint64_t test)
+    {
+        return c.set[pos - 1] == set && c.clear[pos - 1] == clear && c.test[pos - 1] == test;
+    }
+#endif
+}
+
+TEST(instrument_changes)
+{
+#ifdef _BITFIELD_INSTRUMENT
+    instrument::reset();
+#endif
+    perm p = perm();
+    p = RW;
+    p &= ~WRITE;
+    p &= ~WRITE;
+    p |= READ;
+    p ^= EXEC;
+    p <<= 1;
+    TEST_CHECK(word_of(p) == 0x0A);
+    p = 0;
+    TEST_CHECK(word_of(p) == 0);
+    volatile perm v = perm();
+    v |= EXEC;
+    v &= ~EXEC;
+    TEST_CHECK(word_of(v) == 0);
+#ifdef _BITFIELD_INSTRUMENT
+    //only the bits an assignment changes count, the second &= ~WRITE and the |= READ change none
+    const counts_t c = instrument::snapshot();
+    TEST_CHECK(counted(c, 1, 1, 1, 0));
+    TEST_CHECK(counted(c, 2, 2, 2, 0));
+    TEST_CHECK(counted(c, 3, 2, 2, 0));
+    TEST_CHECK(counted(c, 4, 1, 1, 0));
+    TEST_CHECK(counted(c, 5, 0, 0, 0) && counted(c, 8, 0, 0, 0));
+    instrument::reset();
+    TEST_CHECK(counted(instrument::snapshot(), 2, 0, 0, 0));
+#endif
+}
+
+TEST(instrument_tests)
+{
+#ifdef _BITFIELD_INSTRUMENT
+    instrument::reset();
+#endif
+    perm p = perm();
+    p |= READ;
+    std::size_t hits = 0;
+    for (int i = 0; i < 10; ++i)
+    {
+        hits += (p & READ) == READ;
+        hits += (p & RW) == RW;
+    }
+    TEST_CHECK(hits == 10);
+#ifdef _BITFIELD_INSTRUMENT
+    //the mask of & is counted, not the bits that are on
+    TEST_CHECK(p.any(RW) && !p.all(RW) && p.none(EXEC));
+    const counts_t c = instrument::snapshot();
+    TEST_CHECK(counted(c, 1, 1, 0, 22));
+    TEST_CHECK(counted(c, 2, 0, 0, 12));
+    TEST_CHECK(counted(c, 3, 0, 0, 1));
+    //a copy of the whole field isn't an access
+    const perm copy = p;
+    TEST_CHECK(counted(instrument::snapshot(), 1, 1, 0, 22) && word_of(copy) == 1);
+#endif
+}
+
+TEST(instrument_threads)
+{
+#ifdef _BITFIELD_INSTRUMENT
+    instrument::reset();
+#endif
+    //the threads count into their own blocks, folded into the snapshot when they exit
+    constexpr int threads = 4, rounds = 1000;
+    std::size_t cleared[threads] = {};
+    std::vector<std::thread> pool;
+    for (int t = 0; t < threads; ++t)
+    {
+        pool.emplace_back([&cleared, t]
+        {
+            perm q = perm();
+            for (int i = 0; i < rounds; ++i)
+            {
+                q |= WRITE;
+                if (word_of(q & WRITE) != 0)
+                {
+                    q = 0;
+                    ++cleared[t];
+                }
+            }
+        });
+    }
+    for (std::thread& t : pool) t.join();
+    for (const std::size_t n : cleared) TEST_CHECK(n == rounds);
+#ifdef _BITFIELD_INSTRUMENT
+    TEST_CHECK(counted(instrument::snapshot(), 2, threads * rounds, threads * rounds, threads * rounds));
+#endif
+}
+
+TEST(instrument_labels)
+{
+    perm p = local_mask();
+    p |= perm_holder::HIDDEN;
+    TEST_CHECK(word_of(p) == 0xC0);
+#ifdef _BITFIELD_INSTRUMENT
+    //masks register their labels at start up, wherever they are declared
+    TEST_CHECK(std::strcmp(instrument::label(1), "READ") == 0 && std::strcmp(instrument::label(3), "EXEC") == 0);
+    TEST_CHECK(std::strcmp(instrument::label(7), "LOCAL") == 0 && std::strcmp(instrument::label(8), "HIDDEN") == 0);
+    TEST_CHECK(instrument::label(4) == nullptr && instrument::label(0) == nullptr && instrument::label(9) == nullptr);
+
+    //the dumps list the labelled bits and those accessed
+    std::FILE* const out = std::tmpfile();
+    TEST_CHECK(out != nullptr);
+    if (out == nullptr) return;
+    instrument::dump(out, "perm");
+    instrument::dump(out, "perm", bitfield_dump_format::json);
+    std::rewind(out);
+    std::string text;
+    char buffer[256];
+    for (std::size_t n; (n = std::fread(buffer, 1, sizeof(buffer), out)) != 0;) text.append(buffer, n);
+    std::fclose(out);
+    TEST_CHECK(text.compare(0, 5, "perm\n") == 0);
+    TEST_CHECK(text.find("HIDDEN") != std::string::npos && text.find("LOCAL") != std::string::npos);
+    TEST_CHECK(text.find("{\"field\":\"perm\",\"bits\":[{\"bit\":1,\"label\":\"READ\"") != std::string::npos);
+    TEST_CHECK(text.find("{\"bit\":4,") == std::string::npos);
+#endif
+}
@@ -0,0 +1,48 @@
+/*Copyright 2017 Jonathan Campbell
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.*/
+//test entry point - test_bitfield_plain [--list] [name...], fails when a check fails or no test matches
+#include "test.h"
+#include <cstring>
+
+int main(int argc, char** argv)
+{
+    bool list = false;
+    for (int a = 1; a < argc; ++a) list = list || std::strcmp(argv[a], "--list") == 0;
+    std::size_t ran = 0;
+    for (const test_case& c : test_registry())
+    {
+        bool selected = argc == 1 || (list && argc == 2);
+        for (int a = 1; a < argc && !selected; ++a) selected = std::strcmp(argv[a], "--list") != 0 && std::strstr(c.name, argv[a]) != nullptr;
+        if (!selected) continue;
+        if (list) std::printf("%s\n", c.name);
+        else
+        {
+            const std::size_t failed = test_failures();
+            c.run();
+            std::printf("%-24s %s\n", c.name, test_failures() == failed ? "ok" : "FAILED");
+        }
+        ++ran;
+    }
+    if (ran == 0)
+    {
+        std::fprintf(stderr, "no test matches\n");
+        return 1;
+    }
+    if (test_failures() != 0)
+    {
+        std::fprintf(stderr, "%zu checks failed\n", test_failures());
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,92 @@
+/*Copyright 2017 Jonathan Campbell
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.*/
+//codegen parity - functions compiled with and without _BITFIELD by codegen_parity.sh, which diffs their disassembly
+#include "../Bitfield.h"
+
+//The functions have C linkage so their symbols are the same in both builds. They take and return words or
+//pointers, the fields are used inside, as code using BIT_FIELD would. parity_ functions must compile to the
+//same instructions, known_ functions are differences that are understood, see below.
+BIT_FIELD(std::uint32_t, parity_flags);
+#ifdef _BITFIELD
+bitfield_unique_id ui_parity_flags;
+#endif
+BIT_MASK(parity_flags, PARITY_READY, 1);
+BIT_MASK(parity_flags, PARITY_BUSY, 2);
+BIT_MASK(parity_flags, PARITY_DIRTY, 5);
+BIT_MASK(parity_flags, PARITY_ERROR, 9);
+BIT_MASK(parity_flags, PARITY_DONE, 17);
+
+typedef bitfield_traits<parity_flags> parity_traits;
+
+extern "C"
+{
+    void parity_set(parity_flags* f) { *f |= PARITY_BUSY; }
+    void parity_clear(parity_flags* f) { *f &= ~PARITY_BUSY; }
+    void parity_toggle(parity_flags* f) { *f ^= PARITY_DIRTY; }
+    void parity_assign(parity_flags* f) { *f = PARITY_READY | PARITY_DONE; }
+    void parity_reset(parity_flags* f) { *f = 0; }
+    void parity_copy(parity_flags* dst, const parity_flags* src) { *dst = *src; }
+    bool parity_test(const parity_flags* f) { return (*f & PARITY_ERROR) != 0; }
+    bool parity_test_bool(const parity_flags* f) { return static_cast<bool>(*f & PARITY_ERROR); }
+    bool parity_test_all(const parity_flags* f) { return (*f & (PARITY_READY | PARITY_BUSY)) == (PARITY_READY | PARITY_BUSY); }
+    bool parity_equal(const parity_flags* a, const parity_flags* b) { return *a == *b; }
+    bool parity_not(const parity_flags* f) { return !*f; }
+    std::uint32_t parity_combine(const parity_flags* a, const parity_flags* b) { return parity_traits::to_word((*a & *b) | (*a ^ PARITY_DONE)); }
+    std::uint32_t parity_invert(const parity_flags* f) { return parity_traits::to_word(~*f & (PARITY_READY | PARITY_DIRTY)); }
+    std::uint32_t parity_shift(const parity_flags* f) { return parity_traits::to_word((*f << 3) | (*f >> 5)); }
+    unsigned int parity_count(const parity_flags* f) { return bitfield_count(*f); }
+    unsigned int parity_first_set(const parity_flags* f) { return bitfield_first_set(*f); }
+    bool parity_query_all(const parity_flags* f) { return bitfield_all(*f, PARITY_READY | PARITY_DONE); }
+    void parity_volatile(volatile parity_flags* f) { *f |= PARITY_BUSY; *f &= ~PARITY_READY; }
+    bool parity_volatile_test(const volatile parity_flags* f) { return (*f & PARITY_DONE) != 0; }
+
+    //flag-heavy loops
+    void parity_loop_or(parity_flags* r, const std::size_t n) { for (std::size_t i = 0; i < n; ++i) r[i] |= PARITY_DIRTY; }
+    void parity_loop_and_not(parity_flags* r, const std::size_t n) { for (std::size_t i = 0; i < n; ++i) r[i] &= ~(PARITY_BUSY | PARITY_ERROR); }
+    std::size_t parity_loop_count(const parity_flags* r, const std::size_t n)
+    {
+        std::size_t c = 0;
+        for (std::size_t i = 0; i < n; ++i) c += (r[i] & PARITY_READY) != 0;
+        return c;
+    }
+    void parity_loop_copy(parity_flags* dst, const parity_flags* src, const std::size_t n) { for (std::size_t i = 0; i < n; ++i) dst[i] = src[i]; }
+    void parity_state_machine(parity_flags* r, const std::size_t n)
+    {
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            parity_flags& f = r[i];
+            if ((f & PARITY_ERROR) != 0) f &= ~(PARITY_BUSY | PARITY_ERROR);
+            else if ((f & PARITY_BUSY) != 0) { f &= ~PARITY_BUSY; f |= PARITY_DONE | PARITY_DIRTY; }
+            else if ((f & (PARITY_READY | PARITY_DONE)) == PARITY_READY) { f |= PARITY_BUSY; f &= ~PARITY_READY; }
+            else f ^= PARITY_READY;
+        }
+    }
+
+    //Known differences, reported without failing the check. GCC merges two mask tests joined by && into one
+    //test of both bits while it folds the source, which it only sees for plain integers - the checked operators
+    //are inlined later. The plain build then picks a cmov where the checked one branches. Test both bits in one
+    //mask, as parity_state_machine does, to get the same code.
+    bool known_two_tests(const parity_flags* f) { return (*f & PARITY_READY) != 0 && (*f & PARITY_DONE) == 0; }
+    void known_state_machine(parity_flags* r, const std::size_t n)
+    {
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            parity_flags& f = r[i];
+            if ((f & PARITY_ERROR) != 0) f &= ~(PARITY_BUSY | PARITY_ERROR);
+            else if ((f & PARITY_BUSY) != 0) { f &= ~PARITY_BUSY; f |= PARITY_DONE | PARITY_DIRTY; }
+            else if ((f & PARITY_READY) != 0 && (f & PARITY_DONE) == 0) { f |= PARITY_BUSY; f &= ~PARITY_READY; }
+            else f ^= PARITY_READY;
+        }
+    }
+}
@@ -0,0 +1,44 @@
+#!/bin/sh
+# codegen_parity.sh [compiler [flags...]] - checks that the checked build costs nothing over the plain one.
+# Compiles codegen_parity.cpp at -O2 with and without _BITFIELD and diffs the disassembly of every parity_
+# function. Exits 1 and prints the differences if any of them differs. known_ functions are compared and
+# their differences printed, without failing. OBJDUMP picks the disassembler.
+set -eu
+CXX=${1:-c++}
+[ $# -gt 0 ] && shift
+OBJDUMP=${OBJDUMP:-objdump}
+here=$(cd "$(dirname "$0")" && pwd)
+tmp=$(mktemp -d)
+trap 'rm -rf "$tmp"' EXIT
+
+"$CXX" -std=c++17 "$@" -O2 -c "$here/codegen_parity.cpp" -o "$tmp/plain.o"
+"$CXX" -std=c++17 "$@" -O2 -D_BITFIELD -c "$here/codegen_parity.cpp" -o "$tmp/checked.o"
+
+# the instructions of one function, without addresses, so the same code at another offset compares equal
+disassemble() {
+    "$OBJDUMP" -d --no-show-raw-insn --disassemble="$2" "$1" |
+        sed -n "/^[0-9a-f]* <$2>:/,/^\$/p" |
+        sed -e 's/^ *[0-9a-f]*:[[:space:]]*//' -e 's/[0-9a-f]* <\([^>]*\)>/<\1>/g' -e '/^$/d'
+}
+
+functions=$(nm -g --defined-only "$tmp/plain.o" | awk '$3 ~ /^(parity|known)_/ { print $3 }' | sort)
+[ -n "$functions" ] || { echo "codegen_parity: no parity_ functions found" >&2; exit 1; }
+failed=0
+count=0
+identical=0
+for f in $functions; do
+    count=$((count + 1))
+    disassemble "$tmp/plain.o" "$f" > "$tmp/plain.s"
+    disassemble "$tmp/checked.o" "$f" > "$tmp/checked.s"
+    if ! diff -u "$tmp/plain.s" "$tmp/checked.s" > "$tmp/diff"; then
+        case $f in
+        known_*) echo "codegen_parity: $f differs, known" ;;
+        *) echo "codegen_parity: $f differs"; failed=1 ;;
+        esac
+        sed -e '1s|.*|--- plain|' -e '2s|.*|+++ checked|' "$tmp/diff"
+    else
+        identical=$((identical + 1))
+    fi
+done
+echo "codegen_parity: $identical of $count functions identical"
+exit $failed